@@ -0,0 +1,342 @@
+#include "dice/compiled-dice.hpp"
+#include "dice/dice.hpp"
+#include "dice/fixed-dice.hpp"
+#include "dice/output-buffer.hpp"
+#include "dice/random.hpp"
+#include "dice/rational.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Throughput benchmarks for parsing, rolling, rational arithmetic, and
+// output formatting
+
+namespace {
+
+    using clock_type = std::chrono::steady_clock;
+
+    constexpr double min_seconds = 0.2; // Minimum run time for each benchmark
+
+    struct BenchResult {
+        std::string group;
+        std::string name;
+        long long iterations;
+        double ns_per_op;
+    };
+
+    std::vector<BenchResult> results;
+    uint64_t sink = 0; // Keeps the optimizer from discarding the work
+
+    // Grow the iteration count until a run takes long enough to time
+
+    template <typename F>
+    void run(const std::string& group, const std::string& name, F f) {
+        long long n = 1;
+        double seconds = 0;
+        for (;;) {
+            auto start = clock_type::now();
+            sink += f(n);
+            seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+            if (seconds >= min_seconds)
+                break;
+            n *= seconds > 0 ? std::max(2ll, std::min(100ll, (long long)(min_seconds / seconds * 1.2))) : 100;
+        }
+        results.push_back({group, name, n, 1e9 * seconds / double(n)});
+    }
+
+    uint64_t hash(const Rational& r) noexcept {
+        return uint64_t(r.num()) * 31 + uint64_t(r.den());
+    }
+
+    std::string quote(std::string_view str) {
+        std::string out = "\"";
+        for (char c: str) {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out + '"';
+    }
+
+    void print_text() {
+        for (auto& r: results)
+            std::printf("%-10s %-32s %12.2f ns/op %14.0f ops/s\n", r.group.data(), r.name.data(),
+                r.ns_per_op, 1e9 / r.ns_per_op);
+    }
+
+    void print_json() {
+        std::printf("{\n");
+        #ifdef __VERSION__
+            std::printf("    \"compiler\": %s,\n", quote(__VERSION__).data());
+        #endif
+        std::printf("    \"results\": [\n");
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            auto& r = results[i];
+            std::printf("        {\"group\": %s, \"name\": %s, \"iterations\": %lld, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f}%s\n",
+                quote(r.group).data(), quote(r.name).data(), r.iterations, r.ns_per_op, 1e9 / r.ns_per_op,
+                i + 1 < results.size() ? "," : "");
+        }
+        std::printf("    ]\n}\n");
+    }
+
+    void bench_parse() {
+        const char* patterns[] = {
+            "3d6",
+            "3d6+2d10x5/2+10",
+            "d4+d6+d8+d10+d12+d20+2d100x3/4-5/2",
+        };
+        for (auto pattern: patterns)
+            run("parse", pattern, [=] (long long n) {
+                uint64_t sum = 0;
+                for (long long i = 0; i < n; ++i)
+                    sum += Dice(pattern).str().size();
+                return sum;
+            });
+        // Building the same kind of dice with arithmetic operators
+        run("parse", "Dice(2,10)*5+Dice(3,6)+10", [] (long long n) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < n; ++i)
+                sum += uint64_t((Dice(2, 10) * 5 + Dice(3, 6) + 10).scale());
+            return sum;
+        });
+        Dice a(3, 6), b(2, 10);
+        run("parse", "a+b*5/2+a-b+10", [&] (long long n) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < n; ++i)
+                sum += uint64_t((a + b * Rational(5, 2) + a - b + 10).scale());
+            return sum;
+        });
+    }
+
+    void bench_roll() {
+        const char* patterns[] = {
+            "d1000000",                  // Few large dice
+            "2d1000000+d1000",
+            "3d6",                       // Many small dice
+            "100d6",
+            "4d6kh3",                    // Keep modifiers
+            "10d100kl3",
+            "10d6!",                     // Explode and reroll
+            "4d6r1kh3",
+            "12d10>=8",                  // Success pools
+            "500d10>=8",
+            "3d6+2d10x5/2+10",           // Fractional factors
+            "d6/7+d8/11+1/3",
+        };
+        for (auto pattern: patterns) {
+            Dice dice(pattern);
+            run("roll", pattern, [&] (long long n) {
+                std::mt19937 rng(42);
+                uint64_t sum = 0;
+                for (long long i = 0; i < n; ++i)
+                    sum += hash(dice(rng));
+                return sum;
+            });
+        }
+        Dice small("3d6");
+        run("roll", "3d6 (philox)", [&] (long long n) {
+            Philox rng(42);
+            uint64_t sum = 0;
+            for (long long i = 0; i < n; ++i)
+                sum += hash(small(rng));
+            return sum;
+        });
+        Dice dice("100d6");
+        run("roll", "100d6 (roll_n)", [&] (long long n) {
+            std::mt19937 rng(42);
+            std::vector<Rational> out(1024);
+            uint64_t sum = 0;
+            for (long long i = 0; i < n; i += 1024) {
+                auto m = std::size_t(std::min(n - i, 1024ll));
+                dice.roll_n(rng, out.data(), m);
+                sum += hash(out[m - 1]);
+            }
+            return sum;
+        });
+        CompiledDice compiled(Dice("3d6+2d10x5/2+10"));
+        run("roll", "3d6+2d10x5/2+10 (compiled)", [&] (long long n) {
+            std::mt19937 rng(42);
+            uint64_t sum = 0;
+            for (long long i = 0; i < n; ++i)
+                sum += hash(compiled(rng));
+            return sum;
+        });
+        constexpr auto fixed = "3d6+2d10x5/2+10"_dice;
+        run("roll", "3d6+2d10x5/2+10 (fixed)", [&] (long long n) {
+            std::mt19937 rng(42);
+            uint64_t sum = 0;
+            for (long long i = 0; i < n; ++i)
+                sum += hash(fixed(rng));
+            return sum;
+        });
+    }
+
+    void bench_rational() {
+        std::vector<Rational> ints, fracs;
+        for (int i = 0; i < 1024; ++i) {
+            ints.push_back(i % 13 - 6);
+            fracs.push_back(Rational(i % 13 - 6, i % 4 + 1));
+        }
+        run("rational", "integer add", [&] (long long n) {
+            Rational sum;
+            for (long long i = 0; i < n; ++i)
+                sum += ints[i & 1023];
+            return hash(sum);
+        });
+        run("rational", "integer multiply", [&] (long long n) {
+            Rational sum;
+            for (long long i = 0; i < n; ++i)
+                sum += ints[i & 1023] * ints[(i + 1) & 1023];
+            return hash(sum);
+        });
+        run("rational", "fraction add", [&] (long long n) {
+            Rational sum;
+            for (long long i = 0; i < n; ++i)
+                sum += fracs[i & 1023];
+            return hash(sum);
+        });
+        run("rational", "fraction multiply", [&] (long long n) {
+            Rational sum;
+            for (long long i = 0; i < n; ++i)
+                sum += fracs[i & 1023] * fracs[(i + 1) & 1023];
+            return hash(sum);
+        });
+        run("rational", "fraction construct", [&] (long long n) {
+            Rational sum;
+            for (long long i = 0; i < n; ++i)
+                sum += Rational(i & 0xffff, (i & 0xff) + 1).den();
+            return hash(sum);
+        });
+        run("rational", "integer compare", [&] (long long n) {
+            uint64_t count = 0;
+            for (long long i = 0; i < n; ++i)
+                count += ints[i & 1023] < ints[(i + 7) & 1023];
+            return count;
+        });
+        run("rational", "compare", [&] (long long n) {
+            uint64_t count = 0;
+            for (long long i = 0; i < n; ++i)
+                count += fracs[i & 1023] < fracs[(i + 7) & 1023];
+            return count;
+        });
+    }
+
+    // One op is one line of CLI style output ("<index>: <result>\n")
+
+    void bench_output() {
+        std::vector<Rational> values;
+        for (int i = 0; i < 1024; ++i)
+            values.push_back(Rational(i * 7 % 100 - 20, i % 3 + 1));
+        run("output", "ostream mixed", [&] (long long n) {
+            std::ostringstream out;
+            for (long long i = 0; i < n; ++i)
+                out << i + 1 << ": " << values[i & 1023].mixed() << "\n";
+            return uint64_t(out.tellp());
+        });
+        run("output", "buffer mixed", [&] (long long n) {
+            OutputBuffer out;
+            uint64_t bytes = 0;
+            for (long long i = 0; i < n; ++i) {
+                out.write_integer(i + 1);
+                out.write(": ");
+                out.write_mixed(values[i & 1023]);
+                out.write('\n');
+                if (out.size() >= OutputBuffer::default_capacity / 2) {
+                    bytes += out.size();
+                    out.clear();
+                }
+            }
+            return bytes + out.size();
+        });
+        run("output", "buffer decimal", [&] (long long n) {
+            OutputBuffer out;
+            uint64_t bytes = 0;
+            for (long long i = 0; i < n; ++i) {
+                out.write_integer(i + 1);
+                out.write(": ");
+                out.write_decimal(double(values[i & 1023]));
+                out.write('\n');
+                if (out.size() >= OutputBuffer::default_capacity / 2) {
+                    bytes += out.size();
+                    out.clear();
+                }
+            }
+            return bytes + out.size();
+        });
+        run("output", "buffer binary", [&] (long long n) {
+            OutputBuffer out;
+            uint64_t bytes = 0;
+            for (long long i = 0; i < n; ++i) {
+                out.write_binary(values[i & 1023]);
+                if (out.size() >= OutputBuffer::default_capacity / 2) {
+                    bytes += out.size();
+                    out.clear();
+                }
+            }
+            return bytes + out.size();
+        });
+    }
+
+}
+
+int main(int argc, char** argv) {
+
+    try {
+
+        bool json = false;
+        std::string filter;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg == "-h" || arg == "--help") {
+                std::printf(
+                    "dice-bench [<options>] [<group>]\n"
+                    "    <options> = One or more of:\n"
+                    "        -j, --json = Write results as JSON\n"
+                    "        -h, --help = Print usage information\n"
+                    "    <group> = Run only one group (parse, roll, rational, output)\n");
+                return 0;
+            } else if (arg == "-j" || arg == "--json") {
+                json = true;
+            } else if (filter.empty() && arg[0] != '-') {
+                filter = arg;
+            } else {
+                throw std::invalid_argument("Invalid argument: " + std::string(arg));
+            }
+        }
+
+        if (filter.empty() || filter == "parse")
+            bench_parse();
+        if (filter.empty() || filter == "roll")
+            bench_roll();
+        if (filter.empty() || filter == "rational")
+            bench_rational();
+        if (filter.empty() || filter == "output")
+            bench_output();
+        if (results.empty())
+            throw std::invalid_argument("Unknown benchmark group: " + filter);
+
+        if (json)
+            print_json();
+        else
+            print_text();
+        std::fprintf(stderr, "(checksum %llu)\n", (unsigned long long)sink);
+
+        return 0;
+
+    }
+
+    catch (const std::exception& ex) {
+        std::fprintf(stderr, "*** %s\n", ex.what());
+        return 1;
+    }
+
+}
@@ -0,0 +1,47 @@
+#include "dice/alias-table.hpp"
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+// Vose's algorithm
+
+AliasTable::AliasTable(const std::vector<real_type>& weights) {
+    auto n = weights.size();
+    if (n == 0 || n > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("Invalid alias table size");
+    real_type total = 0;
+    for (auto w: weights) {
+        if (! (w >= 0))
+            throw std::invalid_argument("Invalid alias table weight");
+        total += w;
+    }
+    if (! (total > 0))
+        throw std::invalid_argument("Invalid alias table weight");
+    prob_.resize(n);
+    alias_.resize(n);
+    std::vector<uint32_t> small, large;
+    for (std::size_t i = 0; i < n; ++i) {
+        prob_[i] = weights[i] * real_type(n) / total;
+        alias_[i] = uint32_t(i);
+        if (prob_[i] < 1)
+            small.push_back(uint32_t(i));
+        else
+            large.push_back(uint32_t(i));
+    }
+    while (! small.empty() && ! large.empty()) {
+        auto s = small.back();
+        auto l = large.back();
+        small.pop_back();
+        alias_[s] = l;
+        prob_[l] -= 1 - prob_[s];
+        if (prob_[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Anything left over is only short of 1 through rounding error
+    for (auto i: small)
+        prob_[i] = 1;
+    for (auto i: large)
+        prob_[i] = 1;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "dice/random.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class AliasTable {
+public:
+    using real_type = double;
+    AliasTable(): prob_{1}, alias_{0} {}
+    explicit AliasTable(const std::vector<real_type>& weights);
+    template <typename RNG> std::size_t operator()(RNG& rng) const;
+    std::size_t size() const noexcept { return prob_.size(); }
+private:
+    std::vector<real_type> prob_;
+    std::vector<uint32_t> alias_;
+};
+
+template <typename RNG>
+std::size_t AliasTable::operator()(RNG& rng) const {
+    auto x = random_unit(rng) * real_type(prob_.size());
+    auto i = std::min(std::size_t(x), prob_.size() - 1);
+    return x - real_type(i) < prob_[i] ? i : alias_[i];
+}
@@ -0,0 +1,13 @@
+#include "dice/compiled-dice.hpp"
+
+CompiledDice::CompiledDice(const Distribution& dist) {
+    std::vector<real_type> weights;
+    for (std::size_t i = 0; i < dist.size(); ++i) {
+        auto p = dist.probability(i);
+        if (p > 0) {
+            weights.push_back(p);
+            values_.push_back(dist.value(i));
+        }
+    }
+    table_ = AliasTable(weights);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "dice/alias-table.hpp"
+#include "dice/dice.hpp"
+#include "dice/distribution.hpp"
+#include "dice/rational.hpp"
+#include <cstddef>
+#include <vector>
+
+class CompiledDice {
+public:
+    using integer_type = int64_t;
+    using real_type = double;
+    using result_type = Rational;
+    CompiledDice(): values_{0} {}
+    explicit CompiledDice(const Dice& dice): CompiledDice(dice.distribution()) {}
+    explicit CompiledDice(const Distribution& dist);
+    template <typename RNG> Rational operator()(RNG& rng) const { return values_[table_(rng)]; }
+    std::size_t size() const noexcept { return values_.size(); }
+    Rational min() const noexcept { return values_.front(); }
+    Rational max() const noexcept { return values_.back(); }
+private:
+    AliasTable table_;
+    std::vector<Rational> values_;
+};
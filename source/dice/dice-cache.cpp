@@ -0,0 +1,111 @@
+#include "dice/dice-cache.hpp"
+#include <stdexcept>
+
+// Class CachedDice
+
+const Distribution& CachedDice::distribution() const {
+    std::call_once(distribution_once_, [this] {
+        distribution_ = std::make_unique<Distribution>(dice_.distribution());
+    });
+    return *distribution_;
+}
+
+const CompiledDice& CachedDice::compiled() const {
+    std::call_once(compiled_once_, [this] {
+        compiled_ = std::make_unique<CompiledDice>(distribution());
+    });
+    return *compiled_;
+}
+
+// Class DiceCache
+
+DiceCache::DiceCache(std::size_t capacity):
+capacity_(capacity) {
+    if (capacity == 0)
+        throw std::invalid_argument("Cache capacity must be positive");
+}
+
+// Parsing is done outside the lock, so one slow pattern does not block
+// other threads; if two threads parse the same pattern at once, the first
+// one to finish wins and the other result is discarded
+
+std::shared_ptr<const CachedDice> DiceCache::get(std::string_view str) {
+
+    std::string text(str);
+
+    {
+        std::lock_guard lock(mutex_);
+        auto i = index_.find(text);
+        if (i != index_.end()) {
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, i->second);
+            return i->second->value;
+        }
+        ++misses_;
+    }
+
+    auto value = std::make_shared<const CachedDice>(Dice(text));
+    auto key = value->dice().str();
+    std::lock_guard lock(mutex_);
+    auto i = index_.find(key);
+
+    if (i != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, i->second);
+        add_alias(i->second, text);
+        return i->second->value;
+    }
+
+    entries_.push_front({key, {}, value});
+    index_[key] = entries_.begin();
+    add_alias(entries_.begin(), text);
+    evict();
+
+    return value;
+
+}
+
+std::size_t DiceCache::size() const {
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+}
+
+std::size_t DiceCache::hits() const {
+    std::lock_guard lock(mutex_);
+    return hits_;
+}
+
+std::size_t DiceCache::misses() const {
+    std::lock_guard lock(mutex_);
+    return misses_;
+}
+
+void DiceCache::clear() {
+    std::lock_guard lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    hits_ = misses_ = 0;
+}
+
+// Only the most recent spellings of each entry are kept, so the index
+// cannot grow without limit through many spellings of the same dice
+
+void DiceCache::add_alias(entry_list::iterator it, const std::string& str) {
+    if (! index_.insert({str, it}).second)
+        return;
+    auto& aliases = it->aliases;
+    if (aliases.size() == max_aliases) {
+        index_.erase(aliases.front());
+        aliases.erase(aliases.begin());
+    }
+    aliases.push_back(str);
+}
+
+void DiceCache::evict() {
+    while (entries_.size() > capacity_) {
+        auto& e = entries_.back();
+        for (auto& alias: e.aliases)
+            index_.erase(alias);
+        index_.erase(e.key);
+        entries_.pop_back();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "dice/compiled-dice.hpp"
+#include "dice/dice.hpp"
+#include "dice/distribution.hpp"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class CachedDice {
+public:
+    explicit CachedDice(const Dice& dice): dice_(dice) {}
+    CachedDice(const CachedDice&) = delete;
+    CachedDice& operator=(const CachedDice&) = delete;
+    const Dice& dice() const noexcept { return dice_; }
+    const Distribution& distribution() const;
+    const CompiledDice& compiled() const;
+private:
+    Dice dice_;
+    mutable std::once_flag distribution_once_;
+    mutable std::once_flag compiled_once_;
+    mutable std::unique_ptr<Distribution> distribution_;
+    mutable std::unique_ptr<CompiledDice> compiled_;
+};
+
+class DiceCache {
+public:
+    static constexpr std::size_t default_capacity = 256;
+    static constexpr std::size_t max_aliases = 8; // Spellings remembered for each entry
+    explicit DiceCache(std::size_t capacity = default_capacity);
+    DiceCache(const DiceCache&) = delete;
+    DiceCache& operator=(const DiceCache&) = delete;
+    std::shared_ptr<const CachedDice> get(std::string_view str);
+    std::size_t capacity() const noexcept { return capacity_; }
+    std::size_t size() const;
+    std::size_t hits() const;
+    std::size_t misses() const;
+    void clear();
+private:
+    struct entry {
+        std::string key; // Canonical form
+        std::vector<std::string> aliases;
+        std::shared_ptr<const CachedDice> value;
+    };
+    using entry_list = std::list<entry>;
+    mutable std::mutex mutex_;
+    std::size_t capacity_;
+    entry_list entries_; // Most recently used first
+    std::unordered_map<std::string, entry_list::iterator> index_;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+    void add_alias(entry_list::iterator it, const std::string& str);
+    void evict();
+};
@@ -1,55 +1,301 @@
 #include "dice/dice.hpp"
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
-#include <regex>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <stdexcept>
+#include <tuple>
 #include <utility>
+#include <vector>
 
-Dice::Dice(std::string_view str) {
-    static const auto char_is_whitespace = [] (char c) noexcept {
-        static constexpr std::string_view whitespace = "\t\n\f\r ";
-        return whitespace.find(c) != std::string::npos;
-    };
-    static const auto parse_integer = [] (const std::string& str, Dice::integer_type def) noexcept {
-        return str.empty() ? def : Dice::integer_type(std::strtoll(str.data(), nullptr, 10));
-    };
-    static const std::regex pattern(
-        "([+-])"               // [1] sign
-        "(?:"
-            "(?:(\\d+)[*x])?"  // [2] left multiplier
-            "(\\d*)"           // [3] number of dice
-            "d(\\d*)"          // [4] number of faces
-            "(?:[*x](\\d+))?"  // [5] right multiplier
-        "|"
-            "(\\d+)"           // [6] fixed modifier
-        ")"
-        "(?:/(\\d+))?",        // [7] divisor
-        std::regex_constants::icase | std::regex_constants::optimize);
-    std::string text(str);
-    text.erase(std::remove_if(text.begin(), text.end(), char_is_whitespace), text.end());
-    if (text.empty())
-        return;
-    if (text[0] != '+' && text[0] != '-')
-        text.insert(0, 1, '+');
-    std::smatch match;
-    auto begin = text.cbegin(), end = text.cend();
-    while (begin != end) {
-        if (! std::regex_search(begin, end, match, pattern, std::regex_constants::match_continuous))
-            throw std::invalid_argument("Invalid dice");
-        auto sign = *match[0].first == '-' ? -1 : 1;
-        auto divisor = parse_integer(match[7], 1);
-        if (match[6].matched) {
-            auto factor1 = parse_integer(match[6], 1);
-            modifier_ += Rational(sign * factor1, divisor);
-        } else {
-            auto factor1 = parse_integer(match[2], 1);
-            auto n_dice = parse_integer(match[3], 1);
-            auto n_faces = parse_integer(match[4], 6);
-            auto factor2 = parse_integer(match[5], 1);
-            insert(n_dice, n_faces, Rational(sign * factor1 * factor2, divisor));
+namespace {
+
+    using integer_type = Dice::integer_type;
+    using real_type = Dice::real_type;
+    __extension__ using wide_type = __int128;
+
+    constexpr auto max_integer = std::numeric_limits<integer_type>::max();
+
+    // Canonical order of groups
+
+    bool group_less(integer_type faces1, const Rational& factor1, const DiceModifiers& mods1,
+            integer_type faces2, const Rational& factor2, const DiceModifiers& mods2) noexcept {
+        if (faces1 != faces2)
+            return faces1 > faces2;
+        if (factor1 != factor2)
+            return factor1 < factor2;
+        return mods1 < mods2;
+    }
+
+    wide_type wide_gcd(wide_type a, wide_type b) noexcept {
+        a = a < 0 ? - a : a;
+        b = b < 0 ? - b : b;
+        while (b != 0)
+            a = std::exchange(b, a % b);
+        return a;
+    }
+
+    // Reduce a non-negative ratio to a Rational, rounding it if it still
+    // does not fit in 64 bits
+
+    Rational fit_ratio(wide_type num, wide_type den) {
+        auto gcd = wide_gcd(num, den);
+        num /= gcd;
+        den /= gcd;
+        while (num > max_integer || den > max_integer) {
+            num = (num + 1) >> 1;
+            den = (den + 1) >> 1;
+        }
+        return Rational(integer_type(num), integer_type(den));
+    }
+
+    // Simplest fraction within a relative error of eps, from the continued
+    // fraction expansion
+
+    Rational fit_real(real_type x, real_type eps) {
+        auto y = std::abs(x);
+        auto limit = real_type(integer_type(1) << 52);
+        real_type p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+        for (auto z = y;;) {
+            auto a = std::floor(z);
+            auto p2 = a * p1 + p0, q2 = a * q1 + q0;
+            if (p2 > limit || q2 > limit)
+                break;
+            p0 = std::exchange(p1, p2);
+            q0 = std::exchange(q1, q2);
+            if (std::abs(y - p1 / q1) <= eps * std::max(y, real_type(1)) || z == a)
+                break;
+            z = 1 / (z - a);
+        }
+        auto num = integer_type(p1);
+        return Rational(x < 0 ? - num : num, integer_type(q1));
+    }
+
+    const Rational& exact_moment(const std::optional<Rational>& x) {
+        if (! x)
+            throw std::overflow_error("Too many dice for exact statistics");
+        return *x;
+    }
+
+    // P(X < Y) for independent X and Y, summing P(Y=y)P(X<y) over the
+    // values of Y, with P(X<y) accumulated from the bottom so no small
+    // probability is found by subtraction
+
+    real_type probability_less(const Distribution& x, const Distribution& y) {
+        real_type sum = 0, below = 0;
+        std::size_t i = 0;
+        for (std::size_t j = 0; j < y.size(); ++j) {
+            auto v = y.value(j);
+            while (i < x.size() && x.value(i) < v)
+                below += x.probability(i++);
+            sum += y.probability(j) * below;
+        }
+        return sum;
+    }
+
+    // Exact mean and variance of the highest k of n dice, counting the ways
+    // of reaching each kept sum out of live_faces^n equally likely rolls,
+    // where live(v) is false for faces that are rerolled. Working down from
+    // the highest face, as in keep_highest_weights() in order-statistics.hpp,
+    // the state is the number of dice assigned so far, holding the number of
+    // ways of reaching it and the sums of the kept total and its square over
+    // those ways. Once k dice are assigned the kept total is fixed, and the
+    // rest can show any lower face, so the work is of order faces*n*k. If
+    // reverse is true the faces are counted from the top, giving the lowest
+    // k dice. The mean and variance are left empty if the counts overflow
+    // 128 bits or the results do not fit in 64 bits.
+
+    template <typename LiveFunction>
+    void keep_highest_moments(integer_type n, integer_type faces, integer_type k, integer_type live_faces,
+            LiveFunction live, bool reverse, std::optional<Rational>& mean, std::optional<Rational>& variance) {
+
+        static constexpr double max_work = 1e7;
+
+        if (double(faces) * double(n) * double(k) > max_work)
+            return;
+        bool ok = true;
+        auto add = [&ok] (wide_type& acc, wide_type x) { ok = ok && ! __builtin_add_overflow(acc, x, &acc); };
+        auto mul = [&ok] (wide_type x, wide_type y) {
+            wide_type z = 0;
+            ok = ok && ! __builtin_mul_overflow(x, y, &z);
+            return z;
+        };
+        wide_type total = 1;
+        for (integer_type i = 0; ok && i < n; ++i)
+            total = mul(total, live_faces);
+        if (! ok)
+            return;
+
+        auto rows = std::size_t(n + 1);
+        std::vector<wide_type> binomial(rows * rows, 0);
+        for (std::size_t m = 0; m < rows; ++m) {
+            binomial[m * rows] = 1;
+            for (std::size_t c = 1; c <= m; ++c) {
+                binomial[m * rows + c] = binomial[(m - 1) * rows + c - 1];
+                add(binomial[m * rows + c], binomial[(m - 1) * rows + c]);
+            }
+        }
+
+        auto states = std::size_t(k);
+        std::vector<wide_type> w(states, 0), s1(states, 0), s2(states, 0), w_next, s1_next, s2_next;
+        wide_type done_w = 0, done_s1 = 0, done_s2 = 0;
+        w[0] = 1;
+        auto move = [&] (std::size_t from, wide_type& to_w, wide_type& to_s1, wide_type& to_s2, wide_type dx, wide_type q) {
+            auto t1 = s1[from], t2 = s2[from];
+            add(t1, mul(dx, w[from]));
+            add(t2, mul(mul(2, dx), s1[from]));
+            add(t2, mul(mul(dx, dx), w[from]));
+            add(to_w, mul(w[from], q));
+            add(to_s1, mul(t1, q));
+            add(to_s2, mul(t2, q));
+        };
+
+        auto below = live_faces; // Live faces no higher than v
+        for (auto v = faces; ok && v >= 1; --v) {
+            if (! live(v))
+                continue;
+            w_next.assign(states, 0);
+            s1_next.assign(states, 0);
+            s2_next.assign(states, 0);
+            for (std::size_t c = 0; ok && c < states; ++c) {
+                if (w[c] == 0)
+                    continue;
+                auto left = std::size_t(n) - c;
+                auto need = states - c;
+                for (std::size_t m = 0; m < need && m <= left; ++m)
+                    move(c, w_next[c + m], s1_next[c + m], s2_next[c + m], mul(m, v), binomial[left * rows + m]);
+                // At least need of the dice left show v, and the rest can
+                // show any lower face
+                wide_type q = 0, power = 1;
+                for (auto m = left; m >= need && ok; --m) {
+                    add(q, mul(binomial[left * rows + m], power));
+                    if (m > need)
+                        power = mul(power, below - 1);
+                }
+                move(c, done_w, done_s1, done_s2, mul(need, v), q);
+            }
+            w.swap(w_next);
+            s1.swap(s1_next);
+            s2.swap(s2_next);
+            --below;
         }
-        begin = match[0].second;
+        if (! ok || done_w != total)
+            return;
+
+        // Mean p/q and mean square a/b, reduced before the variance is
+        // calculated to keep it within 128 bits
+
+        auto gcd = wide_gcd(done_s1, done_w);
+        auto p = done_s1 / gcd, q = done_w / gcd;
+        gcd = wide_gcd(done_s2, done_w);
+        auto a = done_s2 / gcd, b = done_w / gcd;
+        auto kept = p;
+        if (reverse)
+            ok = ! __builtin_sub_overflow(mul(mul(k, faces + 1), q), p, &kept);
+        if (ok && kept <= max_integer && q <= max_integer)
+            mean = Rational(integer_type(kept), integer_type(q));
+        ok = true;
+        auto qq = mul(q, q);
+        auto lcm = ok ? mul(b / wide_gcd(b, qq), qq) : 0;
+        auto num = ok ? mul(a, lcm / b) : 0;
+        ok = ok && ! __builtin_sub_overflow(num, mul(mul(p, p), lcm / qq), &num);
+        if (! ok)
+            return;
+        gcd = wide_gcd(num, lcm);
+        num /= gcd;
+        lcm /= gcd;
+        if (num <= max_integer && lcm <= max_integer)
+            variance = Rational(integer_type(num), integer_type(lcm));
+
     }
+
+    // Mean and variance of the highest k of n dice, in floating point, for
+    // a die whose values 1 to pmf.size() have the given probabilities.
+    // Working down from the highest value, the state is the number of dice
+    // assigned so far, as in the exact version above, but each state holds
+    // only its probability and the first two moments of the kept sum. Once
+    // k dice are assigned the kept sum is fixed, so the work is of order
+    // faces*k^2 however large n is. Values are shifted down by the highest
+    // one to reduce cancellation in the variance.
+
+    void keep_highest_moments(const std::vector<real_type>& pmf, integer_type n, integer_type k,
+            real_type& mean, real_type& variance) {
+        static constexpr real_type min_probability = 1e-30; // Past the mode, the rest are negligible
+        auto rows = std::size_t(k + 1);
+        auto top = integer_type(pmf.size());
+        std::vector<real_type> cdf(pmf.size()), log_int(std::size_t(n + 1), 0);
+        std::partial_sum(pmf.begin(), pmf.end(), cdf.begin());
+        for (integer_type i = 2; i <= n; ++i)
+            log_int[std::size_t(i)] = std::log(real_type(i));
+        std::vector<real_type> w(rows, 0), s1(rows, 0), s2(rows, 0), w_next, s1_next, s2_next;
+        w[0] = 1;
+        for (auto v = top; v >= 1; --v) {
+            auto below = cdf[std::size_t(v - 1)];
+            auto p = below > 0 ? std::min(pmf[std::size_t(v - 1)] / below, real_type(1)) : real_type(0);
+            if (p <= 0)
+                continue;
+            auto x = real_type(v - top);
+            w_next.assign(rows, 0);
+            s1_next.assign(rows, 0);
+            s2_next.assign(rows, 0);
+            w_next[rows - 1] = w[rows - 1];
+            s1_next[rows - 1] = s1[rows - 1];
+            s2_next[rows - 1] = s2[rows - 1];
+            auto add = [&] (integer_type from, integer_type to, real_type dx, real_type q) {
+                auto i = std::size_t(from), j = std::size_t(to);
+                w_next[j] += w[i] * q;
+                s1_next[j] += (s1[i] + dx * w[i]) * q;
+                s2_next[j] += (s2[i] + 2 * dx * s1[i] + dx * dx * w[i]) * q;
+            };
+            for (integer_type c = 0; c < k; ++c) {
+                if (w[std::size_t(c)] == 0)
+                    continue;
+                auto left = n - c;
+                auto need = k - c;
+                real_type sum = 0;
+                if (p < 1) {
+                    // Binomial probabilities of m of the dice left showing v
+                    auto log_p = real_type(left) * std::log1p(- p);
+                    auto log_ratio = std::log(p) - std::log1p(- p);
+                    auto mode = real_type(left + 1) * p;
+                    for (integer_type m = 0; m < need; ++m) {
+                        auto q = std::exp(log_p);
+                        if (q < min_probability && real_type(m) > mode)
+                            break;
+                        add(c, c + m, x * real_type(m), q);
+                        sum += q;
+                        log_p += log_int[std::size_t(left - m)] - log_int[std::size_t(m + 1)] + log_ratio;
+                    }
+                }
+                add(c, k, x * real_type(need), std::max(1 - sum, real_type(0)));
+            }
+            w.swap(w_next);
+            s1.swap(s1_next);
+            s2.swap(s2_next);
+        }
+        mean = s1[rows - 1] + real_type(k * top);
+        variance = std::max(s2[rows - 1] - s1[rows - 1] * s1[rows - 1], real_type(0));
+    }
+}
+
+struct Dice::moment_cache {
+    std::once_flag once;
+    std::optional<Rational> mean; // Empty if there is no exact value
+    std::optional<Rational> variance;
+    real_type approx_mean = 0;
+    real_type approx_variance = 0;
+};
+
+Dice::Dice(std::string_view str) {
+    parse_dice(str,
+        [this] (integer_type n, integer_type faces, const Rational& factor, const DiceModifiers& mods) {
+            insert(n, faces, factor, mods);
+        },
+        [this] (const Rational& r) { modifier_ += r; });
+    update_scale();
 }
 
 Dice Dice::operator-() const {
@@ -57,24 +303,17 @@ Dice Dice::operator-() const {
     for (auto& g: d.groups_)
         g.factor = - g.factor;
     d.modifier_ = - d.modifier_;
+    d.update_scale();
     return d;
 }
 
 Dice& Dice::operator+=(const Dice& rhs) {
-    Dice d = *this;
-    for (auto& g: rhs.groups_)
-        d.insert(g.n_dice, g.one_dice.b(), g.factor);
-    d.modifier_ += rhs.modifier_;
-    *this = std::move(d);
+    merge(rhs, false);
     return *this;
 }
 
 Dice& Dice::operator-=(const Dice& rhs) {
-    Dice d = *this;
-    for (auto& g: rhs.groups_)
-        d.insert(g.n_dice, g.one_dice.b(), - g.factor);
-    d.modifier_ -= rhs.modifier_;
-    *this = std::move(d);
+    merge(rhs, true);
     return *this;
 }
 
@@ -87,45 +326,125 @@ Dice& Dice::operator*=(const Rational& rhs) {
         groups_.clear();
         modifier_ = 0;
     }
+    update_scale();
     return *this;
 }
 
-Rational Dice::mean() const noexcept {
+Rational Dice::mean() const {
     Rational sum = modifier_;
-    for (auto& g: groups_)
-        sum += Rational(g.n_dice * (g.one_dice.b() + 1)) * g.factor / Rational(2);
+    for (auto& g: groups_) {
+        if (g.mods().is_plain())
+            sum += Rational(g.n_dice * (g.one_dice.b() + 1)) * g.factor / Rational(2);
+        else if (g.mods().keep != DiceModifiers::keep_mode::all)
+            sum += exact_moment(keep_moments(g).mean) * g.factor;
+        else
+            sum += group_moments(g).first * g.factor;
+    }
     return sum;
 }
 
-Rational Dice::variance() const noexcept {
+Rational Dice::variance() const {
     Rational sum;
+    for (auto& g: groups_) {
+        if (g.mods().is_plain())
+            sum += Rational(g.n_dice * (g.one_dice.b() * g.one_dice.b() - 1)) * g.factor * g.factor / Rational(12);
+        else if (g.mods().keep != DiceModifiers::keep_mode::all)
+            sum += exact_moment(keep_moments(g).variance) * g.factor * g.factor;
+        else
+            sum += group_moments(g).second * g.factor * g.factor;
+    }
+    return sum;
+}
+
+Dice::real_type Dice::approx_mean() const {
+    auto sum = real_type(modifier_);
     for (auto& g: groups_)
-        sum += Rational(g.n_dice * (g.one_dice.b() * g.one_dice.b() - 1)) * g.factor * g.factor / Rational(12);
+        sum += approx_group_moments(g).first * real_type(g.factor);
     return sum;
 }
 
-Rational Dice::min() const noexcept {
+Dice::real_type Dice::approx_variance() const {
+    real_type sum = 0;
+    for (auto& g: groups_) {
+        auto factor = real_type(g.factor);
+        sum += approx_group_moments(g).second * factor * factor;
+    }
+    return sum;
+}
+
+Rational Dice::min() const {
     Rational sum = modifier_;
     for (auto& g: groups_) {
         if (g.factor > 0)
-            sum += Rational(g.n_dice) * g.factor;
+            sum += Rational(g.kept() * g.min_value()) * g.factor;
         else
-            sum += Rational(g.n_dice * g.one_dice.b()) * g.factor;
+            sum += Rational(g.kept() * g.max_value()) * g.factor;
     }
     return sum;
 }
 
-Rational Dice::max() const noexcept {
+Rational Dice::max() const {
     Rational sum = modifier_;
     for (auto& g: groups_) {
         if (g.factor > 0)
-            sum += Rational(g.n_dice * g.one_dice.b()) * g.factor;
+            sum += Rational(g.kept() * g.max_value()) * g.factor;
         else
-            sum += Rational(g.n_dice) * g.factor;
+            sum += Rational(g.kept() * g.min_value()) * g.factor;
     }
     return sum;
 }
 
+bool Dice::is_integral() const noexcept {
+    return modifier_.den() == 1 && std::all_of(groups_.begin(), groups_.end(),
+        [] (const dice_group& g) { return g.factor.den() == 1; });
+}
+
+Distribution Dice::distribution() const {
+    Distribution dist(modifier_);
+    for (auto& g: groups_)
+        dist += group_distribution(g) * g.factor;
+    return dist;
+}
+
+// The probabilities are summed over the two distributions directly,
+// instead of going through the FFT convolution in margin(), whose rounding
+// error would swamp a small probability. A small probability comes out
+// as a product of small probabilities.
+
+Dice::comparison Dice::compare(const Dice& rhs) const {
+    auto x = distribution();
+    auto y = rhs.distribution();
+    comparison c;
+    c.win = probability_less(y, x);
+    c.loss = probability_less(x, y);
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < x.size() && j < y.size(); ++i) {
+        auto v = x.value(i);
+        while (j < y.size() && y.value(j) < v)
+            ++j;
+        if (j < y.size() && y.value(j) == v)
+            c.tie += x.probability(i) * y.probability(j);
+    }
+    return c;
+}
+
+void Dice::set_sampling(sampling_mode mode, integer_type threshold) {
+    if (threshold < 1)
+        throw std::invalid_argument("Invalid sampling threshold");
+    sampling_ = mode;
+    threshold_ = threshold;
+    for (auto& g: groups_)
+        prepare(g);
+}
+
+void Dice::set_tolerance(real_type eps) {
+    if (! (eps > 0 && eps < 1))
+        throw std::invalid_argument("Invalid tolerance");
+    tolerance_ = eps;
+    for (auto& g: groups_)
+        prepare(g);
+}
+
 std::string Dice::str() const {
     std::string text;
     for (auto& g: groups_) {
@@ -133,6 +452,19 @@ std::string Dice::str() const {
         if (g.n_dice > 1)
             text += std::to_string(g.n_dice);
         text += 'd' + std::to_string(g.one_dice.b());
+        auto& m = g.mods();
+        if (m.explode == DiceModifiers::explode_mode::explode)
+            text += '!';
+        else if (m.explode == DiceModifiers::explode_mode::compound)
+            text += "!!";
+        for (std::size_t i = 0; i < m.n_rerolls; ++i)
+            text += 'r' + std::to_string(m.rerolls[i]);
+        if (m.success == DiceModifiers::success_mode::at_least)
+            text += ">=" + std::to_string(m.target);
+        else if (m.success == DiceModifiers::success_mode::at_most)
+            text += "<=" + std::to_string(m.target);
+        if (m.keep != DiceModifiers::keep_mode::all)
+            text += (m.keep == DiceModifiers::keep_mode::highest ? "kh" : "kl") + std::to_string(g.kept());
         auto n = std::abs(g.factor.num());
         if (n > 1)
             text += '*' + std::to_string(n);
@@ -151,24 +483,386 @@ std::string Dice::str() const {
     return text;
 }
 
-void Dice::insert(integer_type n, integer_type faces, const Rational& factor) {
-    static const auto match_terms = [] (const dice_group& g1, const dice_group& g2) noexcept {
-        return g1.one_dice.b() == g2.one_dice.b() && g1.factor == g2.factor;
-    };
-    static const auto sort_terms = [] (const dice_group& g1, const dice_group& g2) noexcept {
-        return g1.one_dice.b() == g2.one_dice.b() ? g1.factor < g2.factor : g1.one_dice.b() > g2.one_dice.b();
-    };
-    if (n < 0 || faces < 0)
+// Groups with keep modifiers are never merged with other groups, since the
+// kept dice are chosen separately from each one. Groups with other
+// modifiers are merged only with groups that have the same modifiers.
+
+void Dice::insert(integer_type n, integer_type faces, const Rational& factor, const DiceModifiers& mods) {
+    using keep_mode = DiceModifiers::keep_mode;
+    if (n < 0 || faces < 0 || (mods.keep != keep_mode::all && (mods.keep_count < 0 || mods.keep_count > n))
+            || (faces > 0 && integer_type(mods.n_rerolls) >= faces)
+            || (mods.n_rerolls > 0 && (mods.rerolls[0] < 1 || mods.rerolls[mods.n_rerolls - 1] > faces))
+            || (mods.success != DiceModifiers::success_mode::none
+                && (mods.explode != DiceModifiers::explode_mode::none || mods.keep != keep_mode::all)))
         throw std::invalid_argument("Invalid dice");
-    if (n > 0 && faces > 0 && factor != 0) {
+    if (n > 0 && faces > 0 && factor != 0 && (mods.keep == keep_mode::all || mods.keep_count > 0)) {
         dice_group g;
         g.one_dice = distribution_type(1, faces);
-        g.n_dice = n;
+        g.n_dice = faces == 1 && mods.keep != keep_mode::all ? mods.keep_count : n;
         g.factor = factor;
-        auto it = std::lower_bound(groups_.begin(), groups_.end(), g, sort_terms);
-        if (it != groups_.end() && match_terms(*it, g))
+        auto m = mods;
+        if (m.keep != keep_mode::all && m.keep_count == g.n_dice) {
+            m.keep = keep_mode::all;
+            m.keep_count = 0;
+        }
+        if (m.is_rerolled(faces))
+            m.explode = DiceModifiers::explode_mode::none;
+        if (! m.is_plain()) {
+            auto& s = edit(g);
+            s.mods = m;
+            if (g.explodes() && g.live_faces() < 2)
+                throw std::invalid_argument("Invalid dice");
+            s.first_roll = distribution_type(1, g.live_faces());
+            s.last_roll = distribution_type(1, g.live_faces() - integer_type(g.explodes()));
+            if (g.explodes()) {
+                // Longest chain that can come from a 53 bit uniform deviate
+                // after the first explosion
+                s.log_faces = std::log(real_type(g.live_faces()));
+                s.max_chain = 1;
+                for (integer_type p = 1; p <= (integer_type(1) << 53) / g.live_faces(); p *= g.live_faces())
+                    ++s.max_chain;
+            }
+        }
+        auto [it, found] = find_group(faces, factor, g.mods());
+        if (found) {
             it->n_dice += g.n_dice;
+            prepare(*it);
+        } else {
+            prepare(g);
+            groups_.insert(it, std::move(g));
+        }
+        update_scale();
+    }
+}
+
+// The groups in rhs are already valid, and no two of them can merge with
+// each other, so each one either adds to one of the groups here or becomes
+// a new group. Every group that has to be prepared again is copied and
+// prepared before anything here is modified, leaving this unchanged if
+// anything throws; the rest are copied straight from rhs, which cannot
+// throw. New groups keep their tables if both sides use the same sampling
+// settings.
+
+void Dice::merge(const Dice& rhs, bool negate) {
+
+    static_assert(std::is_nothrow_copy_constructible_v<dice_group>);
+    static_assert(std::is_nothrow_move_assignable_v<dice_group>);
+
+    struct prepared_group {
+        std::size_t index; // Group to replace, or position to insert
+        bool found;
+        dice_group group;
+    };
+
+    struct added_group {
+        std::size_t index; // Position to insert
+        const dice_group* group;
+        bool copy; // Copied from rhs, factor not yet negated
+    };
+
+    if (&rhs == this) {
+        auto d = rhs;
+        merge(d, negate);
+        return;
+    }
+
+    auto modifier = negate ? modifier_ - rhs.modifier_ : modifier_ + rhs.modifier_;
+    bool same_tables = sampling_ == rhs.sampling_ && threshold_ == rhs.threshold_ && tolerance_ == rhs.tolerance_;
+    SmallVector<prepared_group, inline_groups> prepared;
+    SmallVector<added_group, inline_groups> added;
+    prepared.reserve(rhs.groups_.size()); // Keep pointers into it valid
+
+    for (auto& h: rhs.groups_) {
+        auto factor = negate ? - h.factor : h.factor;
+        auto [it, found] = find_group(h.one_dice.b(), factor, h.mods());
+        auto index = std::size_t(it - groups_.begin());
+        if (found || ! same_tables) {
+            prepared.push_back({index, found, found ? *it : h});
+            auto& g = prepared[prepared.size() - 1].group;
+            if (found)
+                g.n_dice += h.n_dice;
+            else
+                g.factor = factor;
+            prepare(g);
+            if (! found)
+                added.push_back({index, &g, false});
+        } else {
+            added.push_back({index, &h, negate});
+        }
+    }
+
+    // Negation reverses the order of factors among groups with the same
+    // number of faces, so the new groups have to be sorted again by their
+    // final position and key. The sort is stable to keep groups with the
+    // same key in the order they had in rhs.
+
+    auto final_factor = [] (const added_group& a) { return a.copy ? - a.group->factor : a.group->factor; };
+    if (negate)
+        std::stable_sort(added.begin(), added.end(), [&] (const added_group& a, const added_group& b) {
+            if (a.index != b.index)
+                return a.index < b.index;
+            return group_less(a.group->one_dice.b(), final_factor(a), a.group->mods(),
+                b.group->one_dice.b(), final_factor(b), b.group->mods());
+        });
+    groups_.reserve(groups_.size() + added.size());
+
+    // Nothing below can throw. Insertion positions never decrease, because
+    // the new groups are in sorted order.
+
+    for (auto& p: prepared)
+        if (p.found)
+            groups_[p.index] = std::move(p.group);
+    for (std::size_t i = 0; i < added.size(); ++i) {
+        auto it = groups_.insert(groups_.begin() + added[i].index + i, *added[i].group);
+        if (added[i].copy)
+            it->factor = - it->factor;
+    }
+
+    modifier_ = modifier;
+    update_scale();
+
+}
+
+// Groups are kept in canonical order, so equal dice have equal groups in
+// the same order.
+
+bool operator==(const Dice& lhs, const Dice& rhs) noexcept {
+    return lhs.modifier_ == rhs.modifier_
+        && std::equal(lhs.groups_.begin(), lhs.groups_.end(), rhs.groups_.begin(), rhs.groups_.end(),
+            [] (const Dice::dice_group& a, const Dice::dice_group& b) {
+                return a.one_dice.b() == b.one_dice.b() && a.n_dice == b.n_dice
+                    && a.factor == b.factor && a.mods() == b.mods();
+            });
+}
+
+// Groups are sorted by decreasing number of faces, then increasing factor,
+// then modifiers. Returns the group that a new group can merge with, or the
+// position to insert it.
+
+std::pair<Dice::dice_group*, bool> Dice::find_group(integer_type faces, const Rational& factor,
+        const DiceModifiers& mods) noexcept {
+    auto it = std::partition_point(groups_.begin(), groups_.end(), [&] (const dice_group& g) {
+        return group_less(g.one_dice.b(), g.factor, g.mods(), faces, factor, mods);
+    });
+    auto equal = [&] (const dice_group& g) { return g.one_dice.b() == faces && g.factor == factor && g.mods() == mods; };
+    if (mods.keep != DiceModifiers::keep_mode::all)
+        return {std::find_if_not(it, groups_.end(), equal), false};
+    bool found = it != groups_.end() && equal(*it);
+    return {it, found};
+}
+
+// Only modified groups and groups sampled from a table need a state. A
+// state shared with another group is copied before it is changed, so the
+// other group is not affected.
+
+void Dice::prepare(dice_group& g) const {
+    bool use_table = (g.n_dice > 1 || ! g.mods().is_plain())
+        && (sampling_ == sampling_mode::table
+            || (sampling_ >= sampling_mode::normal && g.n_dice < threshold_));
+    if (g.mods().keep != DiceModifiers::keep_mode::all)
+        edit(g).moments = std::make_shared<moment_cache>();
+    if (! use_table && ! g.is_pool()) {
+        if (g.state && g.mods().is_plain())
+            g.state.reset();
+        else if (g.state && g.state->table)
+            edit(g).table.reset();
+        return;
+    }
+    auto& s = edit(g);
+    if (use_table) {
+        s.table = std::make_shared<Distribution>(group_distribution(g));
+        s.table_min = s.table->min().num();
+    } else {
+        s.table.reset();
+    }
+    if (g.is_pool())
+        s.successes = BinomialInteger(g.n_dice, real_type(g.success_faces()) / real_type(g.live_faces()));
+}
+
+Dice::group_state& Dice::edit(dice_group& g) {
+    if (! g.state)
+        g.state = std::make_shared<group_state>();
+    else if (g.state.use_count() > 1)
+        g.state = std::make_shared<group_state>(*g.state);
+    return *g.state;
+}
+
+// Exact mean and variance of one die with rerolls and explosions. The
+// faces left after rerolls are equally likely; with explosions, the last
+// roll is one of the faces left other than the top one, and the number of
+// explosions before it is geometric, with mean 1/(a-1) and variance
+// a/(a-1)^2 for a faces left.
+
+std::pair<Rational, Rational> Dice::die_moments(const dice_group& g) {
+    auto f = wide_type(g.one_dice.b());
+    auto a = wide_type(g.live_faces());
+    if (g.is_pool()) {
+        auto c = wide_type(g.success_faces());
+        return {fit_ratio(c, a), fit_ratio(c * (a - c), a * a)};
+    }
+    auto s1 = f * (f + 1) / 2;
+    auto s2 = f * (f + 1) * (2 * f + 1) / 6;
+    auto& m = g.mods();
+    for (std::size_t i = 0; i < m.n_rerolls; ++i) {
+        s1 -= m.rerolls[i];
+        s2 -= wide_type(m.rerolls[i]) * m.rerolls[i];
+    }
+    if (! g.explodes())
+        return {fit_ratio(s1, a), fit_ratio(s2 * a - s1 * s1, a * a)};
+    s1 -= f;
+    s2 -= f * f;
+    --a;
+    return {fit_ratio(s1 + f, a), fit_ratio(s2 * a - s1 * s1 + f * f * (a + 1), a * a)};
+}
+
+// Groups without a keep modifier are sums of independent dice
+
+std::pair<Rational, Rational> Dice::group_moments(const dice_group& g) {
+    auto moments = die_moments(g);
+    return {moments.first * Rational(g.n_dice), moments.second * Rational(g.n_dice)};
+}
+
+std::pair<Dice::real_type, Dice::real_type> Dice::approx_group_moments(const dice_group& g) const {
+    if (g.mods().keep == DiceModifiers::keep_mode::all) {
+        auto moments = group_moments(g);
+        return {real_type(moments.first), real_type(moments.second)};
+    }
+    auto& cache = keep_moments(g);
+    return {cache.approx_mean, cache.approx_variance};
+}
+
+// Keep groups use exact counting when the counts fit in 128 bits, giving
+// whichever of the mean and variance fit in 64 bits. Otherwise, or if
+// either does not fit, the approximations are calculated in floating point
+// from the distribution of one die, truncated for exploding dice, with its
+// values renumbered from 1. Exploding dice have no exact form here, and are
+// rounded to the simplest fraction within the tolerance. Keeping the lowest
+// dice is keeping the highest with the values reversed.
+
+const Dice::moment_cache& Dice::keep_moments(const dice_group& g) const {
+    auto& cache = *g.state->moments;
+    std::call_once(cache.once, [&] {
+        auto faces = g.one_dice.b();
+        auto k = g.kept();
+        bool high = g.mods().keep == DiceModifiers::keep_mode::highest;
+        if (g.live_faces() == 1) {
+            cache.mean = Rational(k * g.face_value(1));
+            cache.variance = Rational(0);
+        } else if (! g.explodes()) {
+            auto live = [&g,faces,high] (integer_type v) { return ! g.mods().is_rerolled(high ? v : faces + 1 - v); };
+            keep_highest_moments(g.n_dice, faces, k, g.live_faces(), live, ! high, cache.mean, cache.variance);
+        }
+        if (cache.mean && cache.variance) {
+            cache.approx_mean = real_type(*cache.mean);
+            cache.approx_variance = real_type(*cache.variance);
+            return;
+        }
+        auto die = die_distribution(g);
+        auto size = die.size();
+        std::vector<real_type> pmf(size);
+        for (std::size_t i = 0; i < size; ++i)
+            pmf[high ? i : size - 1 - i] = die.probability(i);
+        auto& mean = cache.approx_mean;
+        auto& variance = cache.approx_variance;
+        keep_highest_moments(pmf, g.n_dice, k, mean, variance);
+        if (high)
+            mean += real_type(k) * (real_type(die.min()) - 1);
         else
-            groups_.insert(it, g);
+            mean = real_type(k) * (real_type(die.max()) + 1) - mean;
+        if (g.explodes()) {
+            cache.mean = fit_real(mean, tolerance_);
+            cache.variance = fit_real(variance, tolerance_);
+        }
+    });
+    return cache;
+}
+
+// Explosion chains are truncated where the probability of a longer chain
+// is below the tolerance (divided among the dice in the group), or at the
+// longest chain the generator can produce, in which case the whole tail is
+// included.
+
+Distribution Dice::die_distribution(const dice_group& g) const {
+    auto faces = g.one_dice.b();
+    if (g.mods().is_plain())
+        return Distribution::uniform(1, faces);
+    if (g.is_pool()) {
+        auto c = real_type(g.success_faces());
+        return Distribution::weighted(0, {real_type(g.live_faces()) - c, c});
     }
+    std::vector<real_type> weights(std::size_t(faces), 0);
+    auto& s = *g.state;
+    for (integer_type i = 1; i <= s.last_roll.b(); ++i)
+        weights[std::size_t(g.face_value(i) - 1)] = 1;
+    if (! g.explodes())
+        return Distribution::weighted(1, weights);
+    auto p = 1 / real_type(g.live_faces());
+    auto eps = tolerance_ / real_type(g.n_dice);
+    integer_type chain = 0;
+    for (auto tail = p; chain < s.max_chain && tail > eps; tail *= p)
+        ++chain;
+    if (uint64_t(chain) >= Distribution::max_size / uint64_t(faces))
+        throw std::length_error("Distribution is too large");
+    std::vector<real_type> die(std::size_t((chain + 1) * faces), 0);
+    real_type w = 1;
+    for (integer_type j = 0; j <= chain; ++j, w *= p) {
+        auto wj = j == s.max_chain ? w / (1 - p) : w;
+        for (integer_type i = 0; i < faces; ++i)
+            die[std::size_t(j * faces + i)] = weights[std::size_t(i)] * wj;
+    }
+    return Distribution::weighted(1, die);
+}
+
+Distribution Dice::group_distribution(const dice_group& g) const {
+    switch (g.mods().keep) {
+        case DiceModifiers::keep_mode::highest:  return Distribution::keep_highest(die_distribution(g), g.n_dice, g.kept());
+        case DiceModifiers::keep_mode::lowest:   return Distribution::keep_lowest(die_distribution(g), g.n_dice, g.kept());
+        default:                                 break;
+    }
+    if (g.mods().is_plain())
+        return Distribution::uniform(1, g.one_dice.b()).power(g.n_dice);
+    return die_distribution(g).power(g.n_dice);
+}
+
+// Number of faces, not counting rerolled ones, that are successes in a
+// pool
+
+Dice::integer_type Dice::dice_group::success_faces() const noexcept {
+    auto& m = mods();
+    auto faces = one_dice.b();
+    integer_type low = 1, high = faces;
+    if (m.success == DiceModifiers::success_mode::at_least)
+        low = std::max(m.target, low);
+    else
+        high = std::min(m.target, high);
+    if (low > high)
+        return 0;
+    auto count = high - low + 1;
+    for (std::size_t i = 0; i < m.n_rerolls; ++i)
+        if (m.rerolls[i] >= low && m.rerolls[i] <= high)
+            --count;
+    return count;
+}
+
+// For a pool, these are the range of the number of successes from one die
+
+Dice::integer_type Dice::dice_group::min_value() const noexcept {
+    if (is_pool())
+        return success_faces() == live_faces() ? 1 : 0;
+    return face_value(1);
+}
+
+Dice::integer_type Dice::dice_group::max_value() const noexcept {
+    if (is_pool())
+        return success_faces() > 0 ? 1 : 0;
+    if (! explodes())
+        return face_value(live_faces());
+    return state->max_chain * one_dice.b() + face_value(live_faces() - 1);
+}
+
+void Dice::update_scale() noexcept {
+    scale_ = dice_scale(modifier_, scaled_modifier_, groups_.begin(), groups_.end(),
+        [] (const dice_group& g) -> const Rational& { return g.factor; },
+        [] (const dice_group& g) { return std::pair(g.kept(), g.max_value()); },
+        [] (dice_group& g) -> integer_type& { return g.scaled_factor; });
 }
@@ -1,69 +1,395 @@
 #pragma once
 
+#include "dice/distribution.hpp"
+#include "dice/kernel.hpp"
+#include "dice/parser.hpp"
+#include "dice/random.hpp"
 #include "dice/rational.hpp"
+#include "dice/small-vector.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <ostream>
 #include <random>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+// Common scale of a dice expression, shared by Dice and FixedDice: the lcm
+// of the denominators of the modifier and the group factors, or zero if the
+// largest possible absolute value of a scaled result does not fit in 64
+// bits. For each group, factor(g) gives its factor, max_roll(g) a pair whose
+// product is the largest unscaled sum it can roll, and scaled_factor(g)
+// where to store its factor multiplied by the scale.
+
+template <typename Iterator, typename Factor, typename MaxRoll, typename ScaledFactor>
+constexpr Rational::integer_type dice_scale(const Rational& modifier, Rational::integer_type& scaled_modifier,
+        Iterator first, Iterator last, Factor factor, MaxRoll max_roll, ScaledFactor scaled_factor) noexcept {
+    using integer_type = Rational::integer_type;
+    auto abs = [] (integer_type x, integer_type& y) {
+        if (x >= 0) {
+            y = x;
+            return true;
+        }
+        return ! __builtin_sub_overflow(integer_type(0), x, &y);
+    };
+    integer_type scale = modifier.den();
+    bool ok = true;
+    for (auto it = first; ok && it != last; ++it) {
+        auto d = factor(*it).den();
+        ok = ! __builtin_mul_overflow(scale / std::gcd(scale, d), d, &scale);
+    }
+    integer_type bound = 0;
+    ok = ok && ! __builtin_mul_overflow(modifier.num(), scale / modifier.den(), &scaled_modifier)
+        && abs(scaled_modifier, bound);
+    for (auto it = first; ok && it != last; ++it) {
+        auto& f = factor(*it);
+        auto [count, value] = max_roll(*it);
+        auto& scaled = scaled_factor(*it);
+        integer_type high = 0;
+        ok = ! __builtin_mul_overflow(f.num(), scale / f.den(), &scaled)
+            && ! __builtin_mul_overflow(count, value, &high)
+            && ! __builtin_mul_overflow(scaled, high, &high)
+            && abs(high, high)
+            && ! __builtin_add_overflow(bound, high, &bound);
+    }
+    return ok ? scale : 0;
+}
+
 class Dice {
 public:
     using integer_type = int64_t;
     using real_type = double;
     using result_type = Rational;
+    enum class sampling_mode { roll, table, normal, edgeworth };
+    struct comparison {
+        real_type win = 0; // P(this > rhs)
+        real_type tie = 0; // P(this = rhs)
+        real_type loss = 0; // P(this < rhs)
+    };
+    static constexpr integer_type default_threshold = 1000;
+    static constexpr real_type default_tolerance = 1e-12;
     Dice() = default;
     explicit Dice(integer_type n, integer_type faces = 6, const Rational& factor = 1) { insert(n, faces, factor); }
     explicit Dice(std::string_view str);
-    template <typename RNG> Rational operator()(RNG& rng);
+    template <typename RNG> Rational operator()(RNG& rng) const;
+    template <typename RNG> integer_type roll_scaled(RNG& rng) const;
+    template <typename RNG> void roll_n(RNG& rng, Rational* out, std::size_t n) const;
+    template <typename RNG> void roll_n(RNG& rng, real_type* out, std::size_t n) const;
+    template <typename RNG> void roll_n(RNG& rng, integer_type* out, std::size_t n) const;
     Dice operator+() const { return *this; }
     Dice operator-() const;
     Dice& operator+=(const Dice& rhs);
-    Dice& operator+=(const Rational& rhs) { modifier_ += rhs; return *this; }
+    Dice& operator+=(const Rational& rhs) { modifier_ += rhs; update_scale(); return *this; }
     Dice& operator-=(const Dice& rhs);
-    Dice& operator-=(const Rational& rhs) { modifier_ -= rhs; return *this; }
+    Dice& operator-=(const Rational& rhs) { modifier_ -= rhs; update_scale(); return *this; }
     Dice& operator*=(const Rational& rhs);
     Dice& operator/=(const Rational& rhs) { return *this *= Rational(rhs.den(), rhs.num()); }
-    Rational mean() const noexcept;
-    Rational variance() const noexcept;
-    real_type sd() const noexcept { return std::sqrt(real_type(variance())); }
-    Rational min() const noexcept;
-    Rational max() const noexcept;
+    Rational mean() const;
+    Rational variance() const;
+    real_type approx_mean() const;
+    real_type approx_variance() const;
+    real_type sd() const { return std::sqrt(approx_variance()); }
+    Rational min() const;
+    Rational max() const;
+    bool is_integral() const noexcept;
+    integer_type scale() const noexcept { return scale_; }
+    Distribution distribution() const;
+    Distribution margin(const Dice& rhs) const { return distribution() - rhs.distribution(); }
+    comparison compare(const Dice& rhs) const;
+    sampling_mode sampling() const noexcept { return sampling_; }
+    integer_type threshold() const noexcept { return threshold_; }
+    void set_sampling(sampling_mode mode, integer_type threshold = default_threshold);
+    real_type tolerance() const noexcept { return tolerance_; }
+    void set_tolerance(real_type eps);
     std::string str() const;
+    friend bool operator==(const Dice& lhs, const Dice& rhs) noexcept;
 private:
-    using distribution_type = std::uniform_int_distribution<integer_type>;
+    using distribution_type = UniformInteger;
+    static constexpr std::size_t block_size = 256;
+    static constexpr std::size_t kernel_min = 64;
+    static constexpr integer_type counting_max = 64; // Largest dice for counting sort
+    static constexpr std::size_t inline_groups = 2; // Groups stored without allocation
+    struct moment_cache;
+    struct group_state {
+        DiceModifiers mods;
+        distribution_type first_roll; // Index of a face that is not rerolled
+        distribution_type last_roll; // Index of a face that is not rerolled and does not explode
+        integer_type max_chain = 0; // Longest possible explosion chain
+        real_type log_faces = 0; // Log of the number of faces that are not rerolled
+        BinomialInteger successes; // Success count for a pool
+        std::shared_ptr<const Distribution> table;
+        integer_type table_min = 0;
+        std::shared_ptr<moment_cache> moments; // Mean and variance of a keep group, calculated once
+    };
     struct dice_group {
         distribution_type one_dice;
         integer_type n_dice;
         Rational factor;
+        integer_type scaled_factor = 0; // factor * scale_
+        std::shared_ptr<group_state> state; // Null for plain dice without a table
+        const DiceModifiers& mods() const noexcept { return state ? state->mods : plain_mods; }
+        integer_type kept() const noexcept { return mods().keep == DiceModifiers::keep_mode::all ? n_dice : mods().keep_count; }
+        bool explodes() const noexcept { return mods().explode != DiceModifiers::explode_mode::none; }
+        bool is_pool() const noexcept { return mods().success != DiceModifiers::success_mode::none; }
+        integer_type live_faces() const noexcept { return one_dice.b() - integer_type(mods().n_rerolls); }
+        integer_type face_value(integer_type i) const noexcept;
+        integer_type success_faces() const noexcept;
+        integer_type min_value() const noexcept;
+        integer_type max_value() const noexcept;
     };
-    std::vector<dice_group> groups_;
+    using group_list = SmallVector<dice_group, inline_groups>;
+    static inline const DiceModifiers plain_mods = {};
+    group_list groups_;
     Rational modifier_;
-    void insert(integer_type n, integer_type faces, const Rational& factor);
+    integer_type scale_ = 1;
+    integer_type scaled_modifier_ = 0;
+    sampling_mode sampling_ = sampling_mode::roll;
+    integer_type threshold_ = default_threshold;
+    real_type tolerance_ = default_tolerance;
+    void insert(integer_type n, integer_type faces, const Rational& factor, const DiceModifiers& mods = {});
+    void merge(const Dice& rhs, bool negate);
+    std::pair<dice_group*, bool> find_group(integer_type faces, const Rational& factor, const DiceModifiers& mods) noexcept;
+    static std::pair<Rational, Rational> die_moments(const dice_group& g);
+    static std::pair<Rational, Rational> group_moments(const dice_group& g);
+    std::pair<real_type, real_type> approx_group_moments(const dice_group& g) const;
+    const moment_cache& keep_moments(const dice_group& g) const;
+    Distribution die_distribution(const dice_group& g) const;
+    Distribution group_distribution(const dice_group& g) const;
+    void prepare(dice_group& g) const;
+    static group_state& edit(dice_group& g);
+    void update_scale() noexcept;
+    template <typename RNG> integer_type roll_group(const dice_group& g, RNG& rng) const;
+    template <typename RNG> integer_type roll_modified(const dice_group& g, RNG& rng) const;
+    template <typename RNG> static integer_type roll_die(const dice_group& g, RNG& rng);
+    template <typename RNG> void roll_group_n(const dice_group& g, RNG& rng, DiceKernel* kernel,
+        integer_type* sums, std::size_t n) const;
+    template <typename RNG, typename F> void roll_blocks(RNG& rng, std::size_t n, F f) const;
 };
 
 template <typename RNG>
-Rational Dice::operator()(RNG& rng) {
+Rational Dice::operator()(RNG& rng) const {
+    if (scale_ == 1)
+        return roll_scaled(rng);
+    if (scale_ > 1)
+        return Rational(roll_scaled(rng), scale_);
     Rational sum = modifier_;
-    for (auto& g: groups_) {
-        integer_type roll = 0;
+    for (auto& g: groups_)
+        sum += roll_group(g, rng) * g.factor;
+    return sum;
+}
+
+template <typename RNG>
+Dice::integer_type Dice::roll_scaled(RNG& rng) const {
+    if (scale_ == 0)
+        throw std::overflow_error("Dice results are too large for integer arithmetic");
+    integer_type sum = scaled_modifier_;
+    for (auto& g: groups_)
+        sum += roll_group(g, rng) * g.scaled_factor;
+    return sum;
+}
+
+template <typename RNG>
+void Dice::roll_n(RNG& rng, Rational* out, std::size_t n) const {
+    if (scale_ > 0) {
+        std::vector<integer_type> scaled(n, scaled_modifier_);
+        roll_blocks(rng, n, [&scaled] (const dice_group& g, const integer_type* sums, std::size_t pos, std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i)
+                scaled[pos + i] += sums[i] * g.scaled_factor;
+        });
+        for (std::size_t i = 0; i < n; ++i)
+            out[i] = Rational(scaled[i], scale_);
+        return;
+    }
+    std::fill_n(out, n, modifier_);
+    roll_blocks(rng, n, [out] (const dice_group& g, const integer_type* sums, std::size_t pos, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i)
+            out[pos + i] += sums[i] * g.factor;
+    });
+}
+
+template <typename RNG>
+void Dice::roll_n(RNG& rng, real_type* out, std::size_t n) const {
+    std::fill_n(out, n, real_type(modifier_));
+    roll_blocks(rng, n, [out] (const dice_group& g, const integer_type* sums, std::size_t pos, std::size_t count) {
+        auto factor = real_type(g.factor);
+        for (std::size_t i = 0; i < count; ++i)
+            out[pos + i] += real_type(sums[i]) * factor;
+    });
+}
+
+template <typename RNG>
+void Dice::roll_n(RNG& rng, integer_type* out, std::size_t n) const {
+    if (! is_integral())
+        throw std::invalid_argument("Dice results are not integers");
+    if (scale_ == 0)
+        throw std::overflow_error("Dice results are too large for integer arithmetic");
+    std::fill_n(out, n, modifier_.num());
+    roll_blocks(rng, n, [out] (const dice_group& g, const integer_type* sums, std::size_t pos, std::size_t count) {
+        auto factor = g.factor.num();
+        for (std::size_t i = 0; i < count; ++i)
+            out[pos + i] += sums[i] * factor;
+    });
+}
+
+template <typename RNG, typename F>
+void Dice::roll_blocks(RNG& rng, std::size_t n, F f) const {
+    integer_type sums[block_size];
+    std::optional<DiceKernel> kernel;
+    if (n >= kernel_min)
+        kernel = DiceKernel::from_rng(rng);
+    auto kernel_ptr = kernel ? &*kernel : nullptr;
+    for (std::size_t pos = 0; pos < n; pos += block_size) {
+        auto count = std::min(block_size, n - pos);
+        for (auto& g: groups_) {
+            roll_group_n(g, rng, kernel_ptr, sums, count);
+            f(g, sums, pos, count);
+        }
+    }
+}
+
+template <typename RNG>
+void Dice::roll_group_n(const dice_group& g, RNG& rng, DiceKernel* kernel,
+        integer_type* sums, std::size_t n) const {
+    if (g.state || (sampling_ >= sampling_mode::normal && g.n_dice >= threshold_)) {
+        for (std::size_t i = 0; i < n; ++i)
+            sums[i] = roll_group(g, rng);
+    } else if (kernel && DiceKernel::supports(g.one_dice.b(), g.n_dice)) {
+        uint32_t kernel_sums[block_size];
+        kernel->roll(uint32_t(g.one_dice.b()), uint32_t(g.n_dice), kernel_sums, n);
+        std::copy_n(kernel_sums, n, sums);
+    } else {
+        std::fill_n(sums, n, 0);
+        for (integer_type j = 0; j < g.n_dice; ++j)
+            for (std::size_t i = 0; i < n; ++i)
+                sums[i] += g.one_dice(rng);
+    }
+}
+
+template <typename RNG>
+Dice::integer_type Dice::roll_group(const dice_group& g, RNG& rng) const {
+    if (g.state) {
+        if (g.state->table)
+            return g.state->table_min + integer_type(g.state->table->quantile_index(random_unit(rng)));
+        if (! g.state->mods.is_plain())
+            return roll_modified(g, rng);
+    }
+    if (sampling_ >= sampling_mode::normal && g.n_dice >= threshold_) {
+        // Cornish-Fisher expansion of the sum of n uniform dice; the skewness
+        // is zero, leaving only the excess kurtosis term.
+        auto n = real_type(g.n_dice);
+        auto f = real_type(g.one_dice.b());
+        auto mean = n * (f + 1) / 2;
+        auto sd = std::sqrt(n * (f * f - 1) / 12);
+        auto z = random_normal(rng);
+        if (sampling_ == sampling_mode::edgeworth) {
+            auto kurtosis = - 6 * (f * f + 1) / (5 * n * (f * f - 1));
+            z += kurtosis * (z * z * z - 3 * z) / 24;
+        }
+        auto roll = integer_type(std::llround(mean + sd * z));
+        return std::clamp(roll, g.n_dice, g.n_dice * g.one_dice.b());
+    }
+    integer_type roll = 0;
+    for (integer_type i = 0; i < g.n_dice; ++i)
+        roll += g.one_dice(rng);
+    return roll;
+}
+
+// For keep modifiers, small dice are tallied by face value, and the kept
+// dice read off the counts from the top or bottom; larger or compounding
+// dice use partial selection. Neither needs a full sort.
+
+template <typename RNG>
+Dice::integer_type Dice::roll_modified(const dice_group& g, RNG& rng) const {
+    auto& s = *g.state;
+    if (g.is_pool())
+        return s.successes(rng);
+    integer_type sum = 0;
+    if (s.mods.keep == DiceModifiers::keep_mode::all) {
         for (integer_type i = 0; i < g.n_dice; ++i)
-            roll += g.one_dice(rng);
-        sum += roll * g.factor;
+            sum += roll_die(g, rng);
+        return sum;
+    }
+    auto faces = g.one_dice.b();
+    auto k = s.mods.keep_count;
+    bool high = s.mods.keep == DiceModifiers::keep_mode::highest;
+    if (faces <= counting_max && ! g.explodes()) {
+        integer_type counts[counting_max + 1];
+        std::fill_n(counts + 1, faces, 0);
+        for (integer_type i = 0; i < g.n_dice; ++i)
+            ++counts[roll_die(g, rng)];
+        for (integer_type i = 0, v = high ? faces : 1; k > 0; ++i, v = high ? faces - i : 1 + i) {
+            auto c = std::min(counts[v], k);
+            sum += c * v;
+            k -= c;
+        }
+    } else {
+        integer_type buffer[counting_max];
+        std::vector<integer_type> heap_buffer;
+        auto first = buffer;
+        if (g.n_dice > counting_max) {
+            heap_buffer.resize(std::size_t(g.n_dice));
+            first = heap_buffer.data();
+        }
+        auto last = first + g.n_dice;
+        for (auto p = first; p != last; ++p)
+            *p = roll_die(g, rng);
+        auto mid = first + k;
+        if (high)
+            std::nth_element(first, mid, last, std::greater<integer_type>());
+        else
+            std::nth_element(first, mid, last);
+        for (auto p = first; p != mid; ++p)
+            sum += *p;
     }
     return sum;
 }
 
+// Rerolled faces are skipped by drawing directly from the faces that are
+// left. Once a die explodes, the rest of the chain is geometric, and its
+// length is drawn by inversion instead of rolling until it ends, so the
+// cost of a die does not depend on how many times it explodes.
+
+template <typename RNG>
+Dice::integer_type Dice::roll_die(const dice_group& g, RNG& rng) {
+    auto& s = *g.state;
+    auto faces = g.one_dice.b();
+    auto roll = s.mods.n_rerolls == 0 ? g.one_dice(rng) : g.face_value(s.first_roll(rng));
+    if (roll < faces || ! g.explodes())
+        return roll;
+    auto chain = 1 + integer_type(std::log(1 - random_unit(rng)) / - s.log_faces);
+    return std::min(chain, s.max_chain) * faces + g.face_value(s.last_roll(rng));
+}
+
+inline Dice::integer_type Dice::dice_group::face_value(integer_type i) const noexcept {
+    auto& m = mods();
+    for (std::size_t j = 0; j < m.n_rerolls && m.rerolls[j] <= i; ++j)
+        ++i;
+    return i;
+}
+
 inline Dice operator+(const Dice& lhs, const Dice& rhs) { auto d = lhs; d += rhs; return d; }
+inline Dice operator+(Dice&& lhs, const Dice& rhs) { lhs += rhs; return std::move(lhs); }
 inline Dice operator+(const Dice& lhs, const Rational& rhs) { auto d = lhs; d += rhs; return d; }
+inline Dice operator+(Dice&& lhs, const Rational& rhs) { lhs += rhs; return std::move(lhs); }
 inline Dice operator+(const Rational& lhs, const Dice& rhs) { auto d = rhs; d += lhs; return d; }
 inline Dice operator-(const Dice& lhs, const Dice& rhs) { auto d = lhs; d -= rhs; return d; }
+inline Dice operator-(Dice&& lhs, const Dice& rhs) { lhs -= rhs; return std::move(lhs); }
 inline Dice operator-(const Dice& lhs, const Rational& rhs) { auto d = lhs; d -= rhs; return d; }
+inline Dice operator-(Dice&& lhs, const Rational& rhs) { lhs -= rhs; return std::move(lhs); }
 inline Dice operator-(const Rational& lhs, const Dice& rhs) { auto d = - rhs; d += lhs; return d; }
 inline Dice operator*(const Dice& lhs, const Rational& rhs) { auto d = lhs; d *= rhs; return d; }
+inline Dice operator*(Dice&& lhs, const Rational& rhs) { lhs *= rhs; return std::move(lhs); }
 inline Dice operator*(const Rational& lhs, const Dice& rhs) { auto d = rhs; d *= lhs; return d; }
 inline Dice operator/(const Dice& lhs, const Rational& rhs) { auto d = lhs; d /= rhs; return d; }
+inline Dice operator/(Dice&& lhs, const Rational& rhs) { lhs /= rhs; return std::move(lhs); }
+inline bool operator!=(const Dice& lhs, const Dice& rhs) noexcept { return ! (lhs == rhs); }
 inline std::ostream& operator<<(std::ostream& out, const Dice& d) { return out << d.str(); }
 inline Dice operator""_d4(unsigned long long n) { return Dice(n, 4); }
 inline Dice operator""_d6(unsigned long long n) { return Dice(n, 6); }
@@ -0,0 +1,363 @@
+#include "dice/distribution.hpp"
+#include "dice/order-statistics.hpp"
+#include <algorithm>
+#include <complex>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+    using real_type = Distribution::real_type;
+    using complex_type = std::complex<real_type>;
+
+    constexpr std::size_t fft_cost_factor = 8;
+    constexpr std::size_t fft_min_size = 256;
+    constexpr real_type fft_underflow = 1e-100; // Avoid slow denormal arithmetic
+
+    Rational rational_gcd(const Rational& x, const Rational& y) {
+        auto lcm = std::lcm(x.den(), y.den());
+        auto gcd = std::gcd(x.num() * (lcm / x.den()), y.num() * (lcm / y.den()));
+        return {gcd, lcm};
+    }
+
+    // Twiddle factors for all FFT levels up to size n, laid out so that the
+    // factors for a transform of length 2h are in roots[h...2h-1].
+
+    const std::vector<complex_type>& fft_roots(std::size_t n) {
+        thread_local std::vector<complex_type> roots(2, complex_type(1));
+        static const real_type pi = std::acos(real_type(-1));
+        for (auto h = roots.size(); h < n; h *= 2) {
+            roots.resize(2 * h);
+            for (std::size_t j = 0; j < h; ++j)
+                roots[h + j] = std::polar(real_type(1), - pi * real_type(j) / real_type(h));
+        }
+        return roots;
+    }
+
+    void fft(std::vector<complex_type>& z, bool inverse) {
+        auto n = z.size();
+        if (inverse)
+            std::reverse(z.begin() + 1, z.end());
+        for (std::size_t i = 1, j = 0; i < n; ++i) {
+            auto bit = n >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                std::swap(z[i], z[j]);
+        }
+        auto& roots = fft_roots(n);
+        auto data = reinterpret_cast<real_type*>(z.data());
+        auto rdata = reinterpret_cast<const real_type*>(roots.data());
+        for (std::size_t half = 1; half < n; half *= 2) {
+            for (std::size_t i = 0; i < n; i += 2 * half) {
+                auto p = data + 2 * i;
+                auto q = p + 2 * half;
+                auto r = rdata + 2 * half;
+                for (std::size_t j = 0; j < 2 * half; j += 2) {
+                    auto vr = q[j] * r[j] - q[j + 1] * r[j + 1];
+                    auto vi = q[j] * r[j + 1] + q[j + 1] * r[j];
+                    q[j] = p[j] - vr;
+                    q[j + 1] = p[j + 1] - vi;
+                    p[j] += vr;
+                    p[j + 1] += vi;
+                }
+            }
+        }
+    }
+
+    // The rounding error of an FFT convolution of normalized sequences is
+    // of order size*eps times the largest result. Anything below that is
+    // indistinguishable from zero, including the negative values that the
+    // rounding can produce, and is set to zero, so a probability that
+    // should be tiny does not come out as noise.
+
+    void clear_fft_noise(std::vector<real_type>& out) {
+        auto largest = *std::max_element(out.begin(), out.end());
+        auto bound = real_type(out.size()) * std::numeric_limits<real_type>::epsilon() * largest;
+        for (auto& x: out)
+            if (x < bound)
+                x = 0;
+    }
+
+    // Convolution of two sequences, with the elements of each spaced at
+    // intervals of k1 and k2 in the output. Small convolutions are done
+    // directly; large ones use the squaring trick, packing both inputs into
+    // a single complex FFT: the imaginary part of (a+ib)^2 is 2ab.
+
+    std::vector<real_type> convolve(const std::vector<real_type>& a, std::size_t k1,
+            const std::vector<real_type>& b, std::size_t k2) {
+        auto span1 = (a.size() - 1) * k1;
+        auto span2 = (b.size() - 1) * k2;
+        auto out_size = span1 + span2 + 1;
+        std::size_t fft_size = 1;
+        int log2_size = 0;
+        while (fft_size < out_size) {
+            fft_size <<= 1;
+            ++log2_size;
+        }
+        std::vector<real_type> out(out_size, 0);
+        if (a.size() * b.size() <= fft_cost_factor * fft_size * std::size_t(log2_size)) {
+            for (std::size_t i = 0; i < a.size(); ++i) {
+                auto p = a[i];
+                if (p == 0)
+                    continue;
+                auto ptr = out.data() + i * k1;
+                for (std::size_t j = 0; j < b.size(); ++j)
+                    ptr[j * k2] += p * b[j];
+            }
+        } else {
+            std::vector<complex_type> z(fft_size);
+            for (std::size_t i = 0; i < a.size(); ++i)
+                z[i * k1].real(a[i]);
+            for (std::size_t j = 0; j < b.size(); ++j)
+                z[j * k2].imag(b[j]);
+            fft(z, false);
+            for (auto& c: z)
+                c = {c.real() * c.real() - c.imag() * c.imag(), 2 * c.real() * c.imag()};
+            fft(z, true);
+            auto scale = real_type(0.5) / real_type(fft_size);
+            for (std::size_t i = 0; i < out_size; ++i)
+                out[i] = z[i].imag() * scale;
+            clear_fft_noise(out);
+        }
+        return out;
+    }
+
+    // Convolution of a sequence with itself n times. Small results use
+    // repeated squaring in the time domain; large ones transform the input
+    // once, raise each frequency component to the nth power by repeated
+    // squaring, and transform back.
+
+    std::vector<real_type> convolve_power(const std::vector<real_type>& a, std::size_t n) {
+        auto out_size = (a.size() - 1) * n + 1;
+        if (out_size <= fft_min_size) {
+            std::vector<real_type> out = {1};
+            auto base = a;
+            for (;;) {
+                if (n & 1)
+                    out = convolve(out, 1, base, 1);
+                n >>= 1;
+                if (n == 0)
+                    break;
+                base = convolve(base, 1, base, 1);
+            }
+            return out;
+        }
+        std::size_t fft_size = 1;
+        while (fft_size < out_size)
+            fft_size <<= 1;
+        std::vector<complex_type> z(fft_size);
+        std::copy(a.begin(), a.end(), z.begin());
+        fft(z, false);
+        for (auto& c: z) {
+            complex_type x = 1;
+            complex_type y = c;
+            for (auto k = n;;) {
+                if (k & 1)
+                    x = {x.real() * y.real() - x.imag() * y.imag(), x.real() * y.imag() + x.imag() * y.real()};
+                k >>= 1;
+                if (k == 0)
+                    break;
+                y = {y.real() * y.real() - y.imag() * y.imag(), 2 * y.real() * y.imag()};
+                if (std::abs(y.real()) + std::abs(y.imag()) < fft_underflow) {
+                    x = 0;
+                    break;
+                }
+            }
+            c = x;
+        }
+        fft(z, true);
+        std::vector<real_type> out(out_size);
+        auto scale = real_type(1) / real_type(fft_size);
+        for (std::size_t i = 0; i < out_size; ++i)
+            out[i] = z[i].real() * scale;
+        clear_fft_noise(out);
+        return out;
+    }
+
+}
+
+Distribution Distribution::uniform(integer_type min, integer_type max) {
+    if (min > max)
+        throw std::invalid_argument("Invalid distribution range");
+    if (uint64_t(max - min) >= max_size)
+        throw std::length_error("Distribution is too large");
+    Distribution d;
+    d.offset_ = min;
+    d.pmf_.assign(std::size_t(max - min + 1), 1);
+    d.update_cdf();
+    return d;
+}
+
+// Leading and trailing zero weights are trimmed, so min() and max() are
+// always possible values
+
+Distribution Distribution::weighted(integer_type min, std::vector<real_type> weights) {
+    if (weights.size() >= max_size)
+        throw std::length_error("Distribution is too large");
+    for (auto w: weights)
+        if (! (w >= 0) || ! std::isfinite(w))
+            throw std::invalid_argument("Invalid distribution weights");
+    auto first = std::find_if(weights.begin(), weights.end(), [] (real_type w) { return w > 0; });
+    if (first == weights.end())
+        throw std::invalid_argument("Invalid distribution weights");
+    auto last = std::find_if(weights.rbegin(), weights.rend(), [] (real_type w) { return w > 0; }).base();
+    Distribution d;
+    d.offset_ = min + integer_type(first - weights.begin());
+    d.pmf_.assign(first, last);
+    d.update_cdf();
+    return d;
+}
+
+// Sum of the highest k of n dice (see order-statistics.hpp). The values of
+// the die are renumbered from 1 for the calculation.
+
+Distribution Distribution::keep_highest(const Distribution& die, integer_type n, integer_type k) {
+    if (die.step_ != 1 || die.offset_.den() != 1)
+        throw std::invalid_argument("Invalid distribution for keep");
+    auto faces = integer_type(die.size());
+    if (uint64_t(k) * uint64_t(faces - 1) >= max_size)
+        throw std::length_error("Distribution is too large");
+    std::vector<real_type> binomial(std::size_t((n + 1) * (n + 1)), 0);
+    for (integer_type m = 0; m <= n; ++m) {
+        binomial[std::size_t(m * (n + 1))] = 1;
+        for (integer_type c = 1; c <= m; ++c)
+            binomial[std::size_t(m * (n + 1) + c)] = binomial[std::size_t((m - 1) * (n + 1) + c - 1)]
+                + (c < m ? binomial[std::size_t((m - 1) * (n + 1) + c)] : 0);
+    }
+    auto weight = [&] (integer_type m, integer_type c, integer_type v) {
+        auto below = die.cdf_[std::size_t(v - 1)];
+        if (below <= 0)
+            return c == 0 ? real_type(1) : real_type(0);
+        auto p = std::min(die.pmf_[std::size_t(v - 1)] / below, real_type(1));
+        return binomial[std::size_t(m * (n + 1) + c)] * std::pow(p, real_type(c)) * std::pow(1 - p, real_type(m - c));
+    };
+    auto multiply_add = [] (real_type& acc, real_type x, real_type y) { acc += x * y; };
+    Distribution d;
+    d.offset_ = die.offset_ * k;
+    d.pmf_ = keep_highest_weights<real_type>(n, faces, k, weight, multiply_add);
+    d.update_cdf();
+    return d;
+}
+
+Distribution Distribution::operator-() const {
+    Distribution d = *this;
+    d.offset_ = - max();
+    std::reverse(d.pmf_.begin(), d.pmf_.end());
+    d.update_cdf();
+    return d;
+}
+
+Distribution& Distribution::operator+=(const Distribution& rhs) {
+    if (rhs.size() == 1) {
+        offset_ += rhs.offset_;
+        return *this;
+    }
+    if (size() == 1) {
+        auto offset = offset_ + rhs.offset_;
+        *this = rhs;
+        offset_ = offset;
+        return *this;
+    }
+    auto step = rational_gcd(step_, rhs.step_);
+    auto k1 = std::size_t((step_ / step).num());
+    auto k2 = std::size_t((rhs.step_ / step).num());
+    auto span1 = (size() - 1) * k1;
+    auto span2 = (rhs.size() - 1) * k2;
+    if (span1 >= max_size || span2 >= max_size || span1 + span2 >= max_size)
+        throw std::length_error("Distribution is too large");
+    auto pmf = convolve(pmf_, k1, rhs.pmf_, k2);
+    offset_ += rhs.offset_;
+    step_ = step;
+    pmf_ = std::move(pmf);
+    update_cdf();
+    return *this;
+}
+
+Distribution& Distribution::operator*=(const Rational& rhs) {
+    if (! rhs) {
+        *this = {};
+    } else if (rhs > 0) {
+        offset_ *= rhs;
+        step_ *= rhs;
+    } else {
+        offset_ = max() * rhs;
+        step_ *= - rhs;
+        std::reverse(pmf_.begin(), pmf_.end());
+        update_cdf();
+    }
+    return *this;
+}
+
+Distribution Distribution::power(integer_type n) const {
+    if (n < 0)
+        throw std::invalid_argument("Invalid distribution power");
+    if (n == 0 || size() == 1)
+        return Distribution(offset_ * n);
+    if (size() - 1 >= max_size / std::size_t(n))
+        throw std::length_error("Distribution is too large");
+    Distribution d = *this;
+    d.offset_ *= n;
+    d.pmf_ = convolve_power(pmf_, std::size_t(n));
+    d.update_cdf();
+    return d;
+}
+
+Distribution::real_type Distribution::pmf(const Rational& x) const {
+    auto q = (x - offset_) / step_;
+    if (q.den() != 1 || q < 0 || q.num() >= integer_type(size()))
+        return 0;
+    return pmf_[std::size_t(q.num())];
+}
+
+Distribution::real_type Distribution::cdf(const Rational& x) const {
+    if (x < offset_)
+        return 0;
+    auto i = ((x - offset_) / step_).floor();
+    if (i >= integer_type(size()))
+        return 1;
+    return cdf_[std::size_t(i)];
+}
+
+Rational Distribution::quantile(real_type p) const {
+    if (! (p >= 0 && p <= 1))
+        throw std::invalid_argument("Invalid probability");
+    return value(quantile_index(p));
+}
+
+std::size_t Distribution::quantile_index(real_type p) const noexcept {
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), p);
+    if (it == cdf_.end())
+        --it;
+    return std::size_t(it - cdf_.begin());
+}
+
+Distribution::real_type Distribution::mean() const noexcept {
+    real_type sum = 0;
+    for (std::size_t i = 0; i < size(); ++i)
+        sum += real_type(i) * pmf_[i];
+    return real_type(offset_) + real_type(step_) * sum;
+}
+
+Distribution::real_type Distribution::variance() const noexcept {
+    real_type sum = 0;
+    real_type sum2 = 0;
+    for (std::size_t i = 0; i < size(); ++i) {
+        sum += real_type(i) * pmf_[i];
+        sum2 += real_type(i) * real_type(i) * pmf_[i];
+    }
+    auto step = real_type(step_);
+    return std::max(sum2 - sum * sum, 0.0) * step * step;
+}
+
+void Distribution::update_cdf() {
+    auto total = std::accumulate(pmf_.begin(), pmf_.end(), real_type(0));
+    for (auto& p: pmf_)
+        p /= total;
+    cdf_.resize(pmf_.size());
+    std::partial_sum(pmf_.begin(), pmf_.end(), cdf_.begin());
+    cdf_.back() = 1;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "dice/rational.hpp"
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Probabilities are stored as doubles. Large convolutions go through an
+// FFT, whose rounding error is of order size*epsilon times the largest
+// probability in the result; probabilities below that bound are set to
+// zero, and the rest carry an absolute error of about that size.
+
+class Distribution {
+public:
+    using integer_type = int64_t;
+    using real_type = double;
+    static constexpr std::size_t max_size = std::size_t(1) << 24;
+    Distribution() = default;
+    explicit Distribution(const Rational& x): offset_(x) {}
+    static Distribution uniform(integer_type min, integer_type max);
+    static Distribution weighted(integer_type min, std::vector<real_type> weights);
+    static Distribution keep_highest(integer_type n, integer_type faces, integer_type k)
+        { return keep_highest(uniform(1, faces), n, k); }
+    static Distribution keep_highest(const Distribution& die, integer_type n, integer_type k);
+    static Distribution keep_lowest(integer_type n, integer_type faces, integer_type k)
+        { return keep_lowest(uniform(1, faces), n, k); }
+    static Distribution keep_lowest(const Distribution& die, integer_type n, integer_type k)
+        { return - keep_highest(- die, n, k); }
+    Distribution operator+() const { return *this; }
+    Distribution operator-() const;
+    Distribution& operator+=(const Distribution& rhs);
+    Distribution& operator+=(const Rational& rhs) { offset_ += rhs; return *this; }
+    Distribution& operator-=(const Distribution& rhs) { return *this += - rhs; }
+    Distribution& operator-=(const Rational& rhs) { offset_ -= rhs; return *this; }
+    Distribution& operator*=(const Rational& rhs);
+    Distribution& operator/=(const Rational& rhs) { return *this *= Rational(rhs.den(), rhs.num()); }
+    Distribution power(integer_type n) const;
+    std::size_t size() const noexcept { return pmf_.size(); }
+    Rational value(std::size_t i) const { return offset_ + Rational(integer_type(i)) * step_; }
+    real_type probability(std::size_t i) const noexcept { return i < pmf_.size() ? pmf_[i] : 0; }
+    real_type pmf(const Rational& x) const;
+    real_type cdf(const Rational& x) const;
+    Rational quantile(real_type p) const;
+    std::size_t quantile_index(real_type p) const noexcept;
+    Rational min() const { return offset_; }
+    Rational max() const { return value(size() - 1); }
+    real_type mean() const noexcept;
+    real_type variance() const noexcept;
+    real_type sd() const noexcept { return std::sqrt(variance()); }
+private:
+    Rational offset_;
+    Rational step_ = 1;
+    std::vector<real_type> pmf_ = {1};
+    std::vector<real_type> cdf_ = {1};
+    void update_cdf();
+};
+
+inline Distribution operator+(const Distribution& lhs, const Distribution& rhs) { auto d = lhs; d += rhs; return d; }
+inline Distribution operator+(const Distribution& lhs, const Rational& rhs) { auto d = lhs; d += rhs; return d; }
+inline Distribution operator+(const Rational& lhs, const Distribution& rhs) { auto d = rhs; d += lhs; return d; }
+inline Distribution operator-(const Distribution& lhs, const Distribution& rhs) { auto d = lhs; d -= rhs; return d; }
+inline Distribution operator-(const Distribution& lhs, const Rational& rhs) { auto d = lhs; d -= rhs; return d; }
+inline Distribution operator-(const Rational& lhs, const Distribution& rhs) { auto d = - rhs; d += lhs; return d; }
+inline Distribution operator*(const Distribution& lhs, const Rational& rhs) { auto d = lhs; d *= rhs; return d; }
+inline Distribution operator*(const Rational& lhs, const Distribution& rhs) { auto d = rhs; d *= lhs; return d; }
+inline Distribution operator/(const Distribution& lhs, const Rational& rhs) { auto d = lhs; d /= rhs; return d; }
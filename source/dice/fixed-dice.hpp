@@ -0,0 +1,178 @@
+#pragma once
+
+#include "dice/dice.hpp"
+#include "dice/parser.hpp"
+#include "dice/random.hpp"
+#include "dice/rational.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+template <std::size_t N = 8>
+class FixedDice {
+public:
+    using integer_type = int64_t;
+    using real_type = double;
+    using result_type = Rational;
+    static constexpr std::size_t capacity = N;
+    constexpr FixedDice() = default;
+    constexpr explicit FixedDice(std::string_view str);
+    template <typename RNG> Rational operator()(RNG& rng) const;
+    constexpr Rational mean() const;
+    constexpr Rational variance() const;
+    real_type sd() const { return std::sqrt(real_type(variance())); }
+    constexpr Rational min() const;
+    constexpr Rational max() const;
+    constexpr bool is_integral() const noexcept;
+    constexpr std::size_t groups() const noexcept { return size_; }
+    constexpr integer_type scale() const noexcept { return scale_; }
+    Dice dice() const;
+    std::string str() const { return dice().str(); }
+private:
+    struct dice_group {
+        integer_type n_dice = 0;
+        integer_type faces = 0;
+        Rational factor;
+        integer_type scaled_factor = 0; // factor * scale_
+    };
+    dice_group groups_[N] = {};
+    std::size_t size_ = 0;
+    Rational modifier_;
+    integer_type scale_ = 1;
+    integer_type scaled_modifier_ = 0;
+    constexpr void insert(integer_type n, integer_type faces, const Rational& factor);
+    constexpr void update_scale() noexcept;
+    template <typename RNG> static integer_type roll_group(const dice_group& g, RNG& rng);
+};
+
+template <std::size_t N>
+constexpr FixedDice<N>::FixedDice(std::string_view str) {
+    parse_dice(str,
+        [this] (integer_type n, integer_type faces, const Rational& factor, const DiceModifiers& mods) {
+            if (! mods.is_plain())
+                throw std::invalid_argument("Dice modifiers are not supported in fixed dice");
+            insert(n, faces, factor);
+        },
+        [this] (const Rational& r) { modifier_ += r; });
+    update_scale();
+}
+
+// Groups are rolled in the same order as Dice, so the same RNG state gives
+// the same result
+
+template <std::size_t N>
+template <typename RNG>
+Rational FixedDice<N>::operator()(RNG& rng) const {
+    if (scale_ > 0) {
+        auto sum = scaled_modifier_;
+        for (std::size_t i = 0; i < size_; ++i)
+            sum += roll_group(groups_[i], rng) * groups_[i].scaled_factor;
+        return scale_ == 1 ? Rational(sum) : Rational(sum, scale_);
+    }
+    Rational sum = modifier_;
+    for (std::size_t i = 0; i < size_; ++i)
+        sum += roll_group(groups_[i], rng) * groups_[i].factor;
+    return sum;
+}
+
+template <std::size_t N>
+constexpr Rational FixedDice<N>::mean() const {
+    Rational sum = modifier_;
+    for (std::size_t i = 0; i < size_; ++i) {
+        auto& g = groups_[i];
+        sum += Rational(g.n_dice * (g.faces + 1)) * g.factor / Rational(2);
+    }
+    return sum;
+}
+
+template <std::size_t N>
+constexpr Rational FixedDice<N>::variance() const {
+    Rational sum;
+    for (std::size_t i = 0; i < size_; ++i) {
+        auto& g = groups_[i];
+        sum += Rational(g.n_dice * (g.faces * g.faces - 1)) * g.factor * g.factor / Rational(12);
+    }
+    return sum;
+}
+
+template <std::size_t N>
+constexpr Rational FixedDice<N>::min() const {
+    Rational sum = modifier_;
+    for (std::size_t i = 0; i < size_; ++i) {
+        auto& g = groups_[i];
+        sum += Rational(g.factor > 0 ? g.n_dice : g.n_dice * g.faces) * g.factor;
+    }
+    return sum;
+}
+
+template <std::size_t N>
+constexpr Rational FixedDice<N>::max() const {
+    Rational sum = modifier_;
+    for (std::size_t i = 0; i < size_; ++i) {
+        auto& g = groups_[i];
+        sum += Rational(g.factor > 0 ? g.n_dice * g.faces : g.n_dice) * g.factor;
+    }
+    return sum;
+}
+
+template <std::size_t N>
+constexpr bool FixedDice<N>::is_integral() const noexcept {
+    for (std::size_t i = 0; i < size_; ++i)
+        if (groups_[i].factor.den() != 1)
+            return false;
+    return modifier_.den() == 1;
+}
+
+template <std::size_t N>
+Dice FixedDice<N>::dice() const {
+    Dice d;
+    for (std::size_t i = 0; i < size_; ++i)
+        d += Dice(groups_[i].n_dice, groups_[i].faces, groups_[i].factor);
+    d += modifier_;
+    return d;
+}
+
+// Groups are kept in the same order as in Dice, merging groups with the
+// same faces and factor
+
+template <std::size_t N>
+constexpr void FixedDice<N>::insert(integer_type n, integer_type faces, const Rational& factor) {
+    if (n == 0 || faces == 0 || factor == 0)
+        return;
+    std::size_t i = 0;
+    while (i < size_ && (groups_[i].faces > faces || (groups_[i].faces == faces && groups_[i].factor < factor)))
+        ++i;
+    if (i < size_ && groups_[i].faces == faces && groups_[i].factor == factor) {
+        groups_[i].n_dice += n;
+        return;
+    }
+    if (size_ == N)
+        throw std::length_error("Too many dice groups");
+    for (auto j = size_; j > i; --j)
+        groups_[j] = groups_[j - 1];
+    groups_[i] = {n, faces, factor, 0};
+    ++size_;
+}
+
+template <std::size_t N>
+constexpr void FixedDice<N>::update_scale() noexcept {
+    scale_ = dice_scale(modifier_, scaled_modifier_, groups_, groups_ + size_,
+        [] (const dice_group& g) -> const Rational& { return g.factor; },
+        [] (const dice_group& g) { return std::pair(g.n_dice, g.faces); },
+        [] (dice_group& g) -> integer_type& { return g.scaled_factor; });
+}
+
+template <std::size_t N>
+template <typename RNG>
+typename FixedDice<N>::integer_type FixedDice<N>::roll_group(const dice_group& g, RNG& rng) {
+    UniformInteger one_dice(1, g.faces);
+    integer_type roll = 0;
+    for (integer_type i = 0; i < g.n_dice; ++i)
+        roll += one_dice(rng);
+    return roll;
+}
+
+constexpr FixedDice<> operator""_dice(const char* str, std::size_t len) { return FixedDice<>(std::string_view(str, len)); }
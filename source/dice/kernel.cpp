@@ -0,0 +1,270 @@
+#include "dice/kernel.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define DICE_KERNEL_X86 1
+    #include <immintrin.h>
+#else
+    #define DICE_KERNEL_X86 0
+#endif
+
+// Each lane runs an independent xoshiro128++ generator, and maps its output
+// to [1,faces] by Lemire's multiply-shift method with rejection. Every
+// instruction set draws the same values from each lane in the same order,
+// so the results are identical whichever path is taken.
+
+namespace {
+
+    constexpr std::size_t lanes = DiceKernel::lanes;
+
+    inline uint32_t rotl(uint32_t x, int k) noexcept {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    inline uint32_t next_scalar(uint32_t* state, std::size_t lane) noexcept {
+        auto s = state;
+        auto l = lane;
+        auto result = rotl(s[l] + s[3 * lanes + l], 7) + s[l];
+        auto t = s[lanes + l] << 9;
+        s[2 * lanes + l] ^= s[l];
+        s[3 * lanes + l] ^= s[lanes + l];
+        s[lanes + l] ^= s[2 * lanes + l];
+        s[l] ^= s[3 * lanes + l];
+        s[2 * lanes + l] ^= t;
+        s[3 * lanes + l] = rotl(s[3 * lanes + l], 11);
+        return result;
+    }
+
+    inline uint32_t bounded_scalar(uint32_t* state, std::size_t lane, uint32_t faces, uint32_t threshold) noexcept {
+        for (;;) {
+            auto m = uint64_t(next_scalar(state, lane)) * faces;
+            if (uint32_t(m) >= threshold)
+                return uint32_t(m >> 32) + 1;
+        }
+    }
+
+    void roll_scalar(uint32_t* state, uint32_t faces, uint32_t n_dice, uint32_t* sums, std::size_t n) {
+        uint32_t threshold = uint32_t(- faces) % faces;
+        for (uint32_t j = 0; j < n_dice; ++j) {
+            for (std::size_t i = 0; i < n; i += lanes) {
+                auto count = std::min(lanes, n - i);
+                for (std::size_t l = 0; l < lanes; ++l) {
+                    auto x = bounded_scalar(state, l, faces, threshold);
+                    if (l < count)
+                        sums[i + l] += x;
+                }
+            }
+        }
+    }
+
+    #if DICE_KERNEL_X86
+
+        // Lanes that fail the rejection test are redrawn one at a time
+
+        inline void fix_rejects(uint32_t* state, uint32_t* values, unsigned mask,
+                std::size_t first_lane, uint32_t faces, uint32_t threshold) noexcept {
+            for (std::size_t l = 0; mask != 0; ++l, mask >>= 1)
+                if (mask & 1)
+                    values[l] = bounded_scalar(state, first_lane + l, faces, threshold);
+        }
+
+        __attribute__((target("avx2")))
+        inline void load_avx2(__m256i (&s)[2][4], const uint32_t* state) noexcept {
+            for (int h = 0; h < 2; ++h)
+                for (int k = 0; k < 4; ++k)
+                    s[h][k] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state + k * lanes + 8 * h));
+        }
+
+        __attribute__((target("avx2")))
+        inline void store_avx2(const __m256i (&s)[2][4], uint32_t* state) noexcept {
+            for (int h = 0; h < 2; ++h)
+                for (int k = 0; k < 4; ++k)
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(state + k * lanes + 8 * h), s[h][k]);
+        }
+
+        __attribute__((target("avx512f")))
+        inline void load_avx512(__m512i (&s)[4], const uint32_t* state) noexcept {
+            for (int k = 0; k < 4; ++k)
+                s[k] = _mm512_load_si512(state + k * lanes);
+        }
+
+        __attribute__((target("avx512f")))
+        inline void store_avx512(const __m512i (&s)[4], uint32_t* state) noexcept {
+            for (int k = 0; k < 4; ++k)
+                _mm512_store_si512(state + k * lanes, s[k]);
+        }
+
+        __attribute__((target("avx2")))
+        void roll_avx2(uint32_t* state, uint32_t faces, uint32_t n_dice, uint32_t* sums, std::size_t n) {
+            uint32_t threshold = uint32_t(- faces) % faces;
+            auto vfaces = _mm256_set1_epi32(int(faces));
+            auto vthreshold = _mm256_set1_epi32(int(threshold ^ 0x80000000u));
+            auto vsign = _mm256_set1_epi32(int(0x80000000u));
+            auto vone = _mm256_set1_epi32(1);
+            alignas(32) uint32_t values[8];
+            __m256i s[2][4];
+            load_avx2(s, state);
+            for (uint32_t j = 0; j < n_dice; ++j) {
+                for (std::size_t i = 0; i < n; i += lanes) {
+                    auto count = std::min(lanes, n - i);
+                    for (int h = 0; h < 2; ++h) {
+                        auto& s0 = s[h][0];
+                        auto& s1 = s[h][1];
+                        auto& s2 = s[h][2];
+                        auto& s3 = s[h][3];
+                        auto sum = _mm256_add_epi32(s0, s3);
+                        auto x = _mm256_add_epi32(_mm256_or_si256(_mm256_slli_epi32(sum, 7), _mm256_srli_epi32(sum, 25)), s0);
+                        auto t = _mm256_slli_epi32(s1, 9);
+                        s2 = _mm256_xor_si256(s2, s0);
+                        s3 = _mm256_xor_si256(s3, s1);
+                        s1 = _mm256_xor_si256(s1, s2);
+                        s0 = _mm256_xor_si256(s0, s3);
+                        s2 = _mm256_xor_si256(s2, t);
+                        s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+                        auto even = _mm256_mul_epu32(x, vfaces);
+                        auto odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), vfaces);
+                        auto hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+                        auto lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+                        auto reject = _mm256_cmpgt_epi32(vthreshold, _mm256_xor_si256(lo, vsign));
+                        auto value = _mm256_add_epi32(hi, vone);
+                        auto mask = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(reject)));
+                        if (mask != 0) {
+                            _mm256_store_si256(reinterpret_cast<__m256i*>(values), value);
+                            store_avx2(s, state);
+                            fix_rejects(state, values, mask, 8 * std::size_t(h), faces, threshold);
+                            load_avx2(s, state);
+                            value = _mm256_load_si256(reinterpret_cast<const __m256i*>(values));
+                        }
+                        auto first = 8 * std::size_t(h);
+                        if (first + 8 <= count) {
+                            auto ptr = reinterpret_cast<__m256i*>(sums + i + first);
+                            _mm256_storeu_si256(ptr, _mm256_add_epi32(_mm256_loadu_si256(ptr), value));
+                        } else if (first < count) {
+                            _mm256_store_si256(reinterpret_cast<__m256i*>(values), value);
+                            for (std::size_t l = first; l < count; ++l)
+                                sums[i + l] += values[l - first];
+                        }
+                    }
+                }
+            }
+            store_avx2(s, state);
+        }
+
+        // GCC's AVX-512 headers trip this warning when the instruction set is
+        // only enabled by a target attribute
+
+        #if defined(__GNUC__) && ! defined(__clang__)
+            #pragma GCC diagnostic push
+            #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+        #endif
+
+        __attribute__((target("avx512f")))
+        void roll_avx512(uint32_t* state, uint32_t faces, uint32_t n_dice, uint32_t* sums, std::size_t n) {
+            uint32_t threshold = uint32_t(- faces) % faces;
+            auto vfaces = _mm512_set1_epi32(int(faces));
+            auto vthreshold = _mm512_set1_epi32(int(threshold));
+            auto vone = _mm512_set1_epi32(1);
+            alignas(64) uint32_t values[16];
+            __m512i s[4];
+            load_avx512(s, state);
+            auto& s0 = s[0];
+            auto& s1 = s[1];
+            auto& s2 = s[2];
+            auto& s3 = s[3];
+            for (uint32_t j = 0; j < n_dice; ++j) {
+                for (std::size_t i = 0; i < n; i += lanes) {
+                    auto count = std::min(lanes, n - i);
+                    auto x = _mm512_add_epi32(_mm512_rol_epi32(_mm512_add_epi32(s0, s3), 7), s0);
+                    auto t = _mm512_slli_epi32(s1, 9);
+                    s2 = _mm512_xor_si512(s2, s0);
+                    s3 = _mm512_xor_si512(s3, s1);
+                    s1 = _mm512_xor_si512(s1, s2);
+                    s0 = _mm512_xor_si512(s0, s3);
+                    s2 = _mm512_xor_si512(s2, t);
+                    s3 = _mm512_rol_epi32(s3, 11);
+                    auto even = _mm512_mul_epu32(x, vfaces);
+                    auto odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), vfaces);
+                    auto hi = _mm512_mask_blend_epi32(0xaaaa, _mm512_srli_epi64(even, 32), odd);
+                    auto lo = _mm512_mask_blend_epi32(0xaaaa, even, _mm512_slli_epi64(odd, 32));
+                    auto mask = unsigned(_mm512_cmplt_epu32_mask(lo, vthreshold));
+                    auto value = _mm512_add_epi32(hi, vone);
+                    if (mask != 0) {
+                        _mm512_store_si512(values, value);
+                        store_avx512(s, state);
+                        fix_rejects(state, values, mask, 0, faces, threshold);
+                        load_avx512(s, state);
+                        value = _mm512_load_si512(values);
+                    }
+                    if (count == lanes) {
+                        auto ptr = sums + i;
+                        _mm512_storeu_si512(ptr, _mm512_add_epi32(_mm512_loadu_si512(ptr), value));
+                    } else {
+                        auto keep = __mmask16((1u << count) - 1);
+                        auto ptr = sums + i;
+                        auto old = _mm512_maskz_loadu_epi32(keep, ptr);
+                        _mm512_mask_storeu_epi32(ptr, keep, _mm512_add_epi32(old, value));
+                    }
+                }
+            }
+            store_avx512(s, state);
+        }
+
+        #if defined(__GNUC__) && ! defined(__clang__)
+            #pragma GCC diagnostic pop
+        #endif
+
+    #endif
+
+}
+
+DiceKernel::DiceKernel(uint64_t seed) noexcept {
+    // SplitMix64 to fill the state from a single seed
+    for (std::size_t i = 0; i < 4 * lanes; i += 2) {
+        seed += 0x9e3779b97f4a7c15ull;
+        auto z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        state_[i] = uint32_t(z);
+        state_[i + 1] = uint32_t(z >> 32);
+    }
+    fix_state();
+}
+
+void DiceKernel::roll(uint32_t faces, uint32_t n_dice, uint32_t* sums, std::size_t n, instruction_set is) {
+    if (faces == 0 || ! supports(faces, n_dice))
+        throw std::invalid_argument("Invalid dice for kernel");
+    if (is > best())
+        throw std::invalid_argument("Instruction set is not supported");
+    std::fill_n(sums, n, 0);
+    switch (is) {
+        #if DICE_KERNEL_X86
+            case instruction_set::avx512:  roll_avx512(state_, faces, n_dice, sums, n); break;
+            case instruction_set::avx2:    roll_avx2(state_, faces, n_dice, sums, n); break;
+        #endif
+        default:                           roll_scalar(state_, faces, n_dice, sums, n); break;
+    }
+}
+
+DiceKernel::instruction_set DiceKernel::best() noexcept {
+    #if DICE_KERNEL_X86
+        static const auto is = __builtin_cpu_supports("avx512f") ? instruction_set::avx512
+            : __builtin_cpu_supports("avx2") ? instruction_set::avx2 : instruction_set::scalar;
+        return is;
+    #else
+        return instruction_set::scalar;
+    #endif
+}
+
+bool DiceKernel::supports(int64_t faces, int64_t n_dice) noexcept {
+    return faces >= 1 && n_dice >= 0 && faces <= int64_t(UINT32_MAX)
+        && n_dice <= int64_t(UINT32_MAX) / faces;
+}
+
+void DiceKernel::fix_state() noexcept {
+    // A lane whose state is all zero would only ever produce zero
+    for (std::size_t l = 0; l < lanes; ++l)
+        if ((state_[l] | state_[lanes + l] | state_[2 * lanes + l] | state_[3 * lanes + l]) == 0)
+            state_[l] = 1;
+}
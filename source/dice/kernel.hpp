@@ -0,0 +1,32 @@
+#pragma once
+
+#include "dice/random.hpp"
+#include <cstddef>
+#include <cstdint>
+
+class DiceKernel {
+public:
+    enum class instruction_set { scalar, avx2, avx512 };
+    static constexpr std::size_t lanes = 16;
+    DiceKernel() noexcept: DiceKernel(uint64_t(0)) {}
+    explicit DiceKernel(uint64_t seed) noexcept;
+    template <typename RNG> static DiceKernel from_rng(RNG& rng);
+    void roll(uint32_t faces, uint32_t n_dice, uint32_t* sums, std::size_t n) { roll(faces, n_dice, sums, n, best()); }
+    void roll(uint32_t faces, uint32_t n_dice, uint32_t* sums, std::size_t n, instruction_set is);
+    static instruction_set best() noexcept;
+    static bool supports(int64_t faces, int64_t n_dice) noexcept;
+private:
+    struct unseeded {};
+    alignas(64) uint32_t state_[4 * lanes];
+    explicit DiceKernel(unseeded) noexcept {} // State is filled by the caller
+    void fix_state() noexcept;
+};
+
+template <typename RNG>
+DiceKernel DiceKernel::from_rng(RNG& rng) {
+    DiceKernel k{unseeded()};
+    for (auto& s: k.state_)
+        s = random_bits32(rng);
+    k.fix_state();
+    return k;
+}
@@ -1,37 +1,46 @@
+#include "dice/dice-cache.hpp"
 #include "dice/dice.hpp"
+#include "dice/output-buffer.hpp"
+#include "dice/random.hpp"
 #include "dice/rational.hpp"
+#include "dice/statistics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <exception>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <random>
 #include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
 #include <vector>
 
-int main(int argc, char** argv) {
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
 
-    try {
+namespace {
 
-        std::vector<std::string> args(argv + 1, argv + argc);
-
-        if (args.empty() || args[0] == "-h" || args[0] == "--help") {
-            std::cout <<
-                "dice [<options>] <pattern> [<number>]\n"
-                "    <options> = One or more of:\n"
-                "        -g = Show grand total\n"
-                "        -d = Show non-integer results as decimal instead of fraction\n"
-                "        -r = Round fractions to the nearest integer\n"
-                "        -f = Round fractions down to an integer (floor)\n"
-                "        -c = Round fractions up to an integer (ceiling)\n"
-                "        -z = Force a non-negative result (results <0 reported as 0)\n"
-                "        -p = Force a positive result (results <1 reported as 1)\n"
-                "        -h, --help = Print usage information\n"
-                "    <pattern> = Dice to roll\n"
-                "    <number> = Number of times to roll (default 1)\n";
-            return 0;
-        }
+    constexpr long block_size = 65536;
+    constexpr unsigned blocks_per_thread = 4; // Blocks in flight per thread
 
+    struct Options {
         bool use_grand = false;
         bool use_decimal = false;
         bool use_round = false;
@@ -39,71 +48,657 @@ int main(int argc, char** argv) {
         bool use_ceil = false;
         bool use_zero = false;
         bool use_positive = false;
+        bool use_binary = false;
+        bool use_stats = false;
+        bool show_seed = false;
+        bool serve = false;
+        std::string socket; // Unix domain socket path for server mode
+        uint64_t seed = 0;
+        uint64_t stream = 0;
+        uint64_t offset = 0; // Index of the first roll
+    };
 
-        while (! args.empty() && args[0][0] == '-') {
-            for (char c: args[0].substr(1)) {
-                switch (c) {
-                    case 'g':  use_grand = true; break;
-                    case 'd':  use_decimal = true; break;
-                    case 'r':  use_round = true; break;
-                    case 'f':  use_floor = true; break;
-                    case 'c':  use_ceil = true; break;
-                    case 'z':  use_zero = true; break;
-                    case 'p':  use_positive = true; break;
-                    default:   throw std::invalid_argument("Invalid flags: " + args[0]);
+    struct BlockResult {
+        OutputBuffer out{0}; // Sized by roll_block()
+        Rational total;
+        RollStatistics stats;
+        std::exception_ptr error;
+    };
+
+    // Rounding and clamping are monotonic, so applying them to the range of
+    // the dice gives the range of the transformed results
+
+    Rational transform(Rational x, const Options& opt) {
+        if (opt.use_round)
+            x = x.round();
+        else if (opt.use_floor)
+            x = x.floor();
+        else if (opt.use_ceil)
+            x = x.ceil();
+        if (opt.use_zero && x < 0)
+            x = 0;
+        else if (opt.use_positive && x < 1)
+            x = 1;
+        return x;
+    }
+
+    RollStatistics make_statistics(const Dice& dice, const Options& opt) {
+        auto scale = opt.use_round || opt.use_floor || opt.use_ceil ? 1 : dice.scale();
+        return RollStatistics(transform(dice.min(), opt), transform(dice.max(), opt), scale);
+    }
+
+    // Rolls are generated in fixed chunks, each starting at its own position
+    // in the Philox sequence for the seed and stream, so any roll can be
+    // reproduced by generating only its own chunk, and the results do not
+    // depend on the number of threads or the starting offset. Chunks are
+    // rolled as a batch so roll_n() can use the vectorized kernel. The
+    // number of random words a roll needs has no fixed bound (rejection
+    // sampling can always ask for another), so the words actually used by
+    // each chunk are checked, and a chunk that would run into the next one
+    // is an error instead of silently sharing its random numbers.
+
+    constexpr uint64_t chunk_size = 64;
+    constexpr int chunk_shift = 32; // Random words reserved for each chunk
+    constexpr uint64_t chunk_words = uint64_t(1) << chunk_shift;
+    constexpr uint64_t max_rolls = chunk_size << (64 - chunk_shift);
+
+    uint64_t parse_number(const std::string& name, const std::string& value) {
+        if (value.empty() || value.size() > 20 || value.find_first_not_of("0123456789") != std::string::npos)
+            throw std::invalid_argument("Invalid " + name + ": " + value);
+        errno = 0;
+        auto n = std::strtoull(value.data(), nullptr, 10);
+        if (errno == ERANGE)
+            throw std::invalid_argument("Invalid " + name + ": " + value);
+        return n;
+    }
+
+    BlockResult roll_block(const Dice& dice, const Options& opt, const RollStatistics& stats, long number, long block) {
+
+        BlockResult res;
+        res.stats = stats;
+
+        try {
+
+            Philox rng(opt.seed, opt.stream);
+            auto first = opt.offset + uint64_t(block * block_size);
+            auto count = uint64_t(std::min(number - block * block_size, block_size));
+            auto skip = first % chunk_size;
+            auto chunks = (skip + count + chunk_size - 1) / chunk_size;
+            auto results = std::vector<Rational>(chunks * chunk_size);
+            if (! opt.use_stats)
+                res.out = OutputBuffer(std::size_t(count) * (opt.use_binary ? 16 : 32));
+
+            for (uint64_t i = 0; i < chunks; ++i) {
+                auto start = (first / chunk_size + i) << chunk_shift;
+                rng.seek(start);
+                dice.roll_n(rng, results.data() + i * chunk_size, chunk_size);
+                if (rng.tell() - start > chunk_words)
+                    throw std::length_error("Too many random numbers needed for each roll");
+            }
+
+            for (uint64_t i = 0; i < count; ++i) {
+                auto index = first + i;
+                auto result = transform(results[skip + i], opt);
+                res.total += result;
+                if (opt.use_stats) {
+                    res.stats.add(result);
+                    continue;
                 }
+                if (opt.use_binary) {
+                    if (opt.use_decimal)
+                        res.out.write_binary(double(result));
+                    else
+                        res.out.write_binary(result);
+                    continue;
+                }
+                if (number > 1) {
+                    res.out.write_integer(int64_t(index + 1));
+                    res.out.write(": ");
+                }
+                if (opt.use_decimal)
+                    res.out.write_decimal(double(result));
+                else
+                    res.out.write_mixed(result);
+                res.out.write('\n');
+            }
+
+        }
+
+        catch (...) {
+            res.error = std::current_exception();
+        }
+
+        return res;
+
+    }
+
+    std::string format_value(const Rational& x, const Options& opt) {
+        OutputBuffer out(32);
+        if (opt.use_decimal)
+            out.write_decimal(double(x));
+        else
+            out.write_mixed(x);
+        return std::string(out.view());
+    }
+
+    std::string format_value(double x) {
+        OutputBuffer out(32);
+        out.write_decimal(x);
+        return std::string(out.view());
+    }
+
+    // Consecutive bins are grouped to keep the histogram to a readable size
+
+    void print_statistics(std::ostream& out, const Dice& dice, const Options& opt, const RollStatistics& stats) {
+
+        static constexpr std::size_t max_rows = 40;
+        static constexpr std::size_t bar_width = 50;
+        static constexpr double percentiles[] = {1, 5, 25, 50, 75, 95, 99};
+
+        out << "Rolls:        " << stats.count() << "\n";
+        if (stats.count() == 0)
+            return;
+
+        // Large keep groups may have no exact mean
+
+        std::string mean;
+        try {
+            mean = format_value(dice.mean(), opt);
+        }
+        catch (const std::overflow_error&) {
+            mean = "~" + format_value(dice.approx_mean());
+        }
+
+        out
+            << "Min:          " << format_value(stats.min(), opt) << " (dice: " << format_value(dice.min(), opt) << ")\n"
+            << "Max:          " << format_value(stats.max(), opt) << " (dice: " << format_value(dice.max(), opt) << ")\n"
+            << "Mean:         " << format_value(stats.mean()) << " (dice: " << mean << ")\n"
+            << "SD:           " << format_value(stats.sd()) << " (dice: " << format_value(dice.sd()) << ")\n"
+            << "Percentiles: ";
+        for (auto p: percentiles)
+            out << " " << p << "%=" << format_value(stats.percentile(p));
+        out << "\n" << "Histogram:\n";
+
+        auto group = (stats.bins() + max_rows - 1) / max_rows;
+        std::vector<std::string> labels;
+        std::vector<RollStatistics::count_type> counts;
+        RollStatistics::count_type max_count = 0;
+
+        for (std::size_t i = 0; i < stats.bins(); i += group) {
+            auto j = std::min(i + group, stats.bins());
+            RollStatistics::count_type count = 0;
+            for (auto k = i; k < j; ++k)
+                count += stats.bin_count(k);
+            auto label = format_value(stats.bin_value(i));
+            if (! stats.is_exact())
+                label += " - " + format_value(stats.bin_value(j));
+            else if (j - i > 1)
+                label += " - " + format_value(stats.bin_value(j - 1));
+            labels.push_back(label);
+            counts.push_back(count);
+            max_count = std::max(max_count, count);
+        }
+
+        std::size_t label_width = 0;
+        for (auto& label: labels)
+            label_width = std::max(label_width, label.size());
+
+        for (std::size_t i = 0; i < labels.size(); ++i) {
+            auto bar = std::size_t(double(counts[i]) / double(max_count) * double(bar_width) + 0.5);
+            out << "    " << std::setw(int(label_width)) << labels[i] << "  " << std::setw(12) << counts[i]
+                << "  " << std::setw(9) << std::fixed << std::setprecision(4)
+                << 100 * double(counts[i]) / double(stats.count()) << "%  "
+                << std::defaultfloat << std::setprecision(6) << std::string(bar, '#') << "\n";
+        }
+
+    }
+
+    // Worker threads claim blocks in order, but never run more than a fixed
+    // number of blocks ahead of the output; the main thread writes each
+    // block's output in order as it becomes available. A single block is
+    // rolled directly on the main thread.
+
+    class BlockRunner {
+    public:
+        BlockRunner(const Dice& dice, const Options& opt, const RollStatistics& stats,
+            long number, unsigned threads);
+        ~BlockRunner() noexcept;
+        void run(std::FILE* out, Rational& total, RollStatistics& stats);
+    private:
+        const Dice& dice_;
+        const Options& opt_;
+        const RollStatistics& stats_;
+        long number_;
+        long blocks_;
+        long window_;
+        long next_ = 0;
+        long written_ = 0;
+        bool stop_ = false;
+        std::vector<std::optional<BlockResult>> slots_;
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        void work();
+    };
+
+    BlockRunner::BlockRunner(const Dice& dice, const Options& opt, const RollStatistics& stats,
+        long number, unsigned threads):
+    dice_(dice), opt_(opt), stats_(stats), number_(number), blocks_((number + block_size - 1) / block_size),
+    window_(long(threads * blocks_per_thread)), slots_(std::size_t(window_)) {
+        threads = blocks_ > 1 ? unsigned(std::min(long(threads), blocks_)) : 0;
+        for (unsigned i = 0; i < threads; ++i)
+            threads_.emplace_back([this] { work(); });
+    }
+
+    BlockRunner::~BlockRunner() noexcept {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t: threads_)
+            t.join();
+    }
+
+    void BlockRunner::run(std::FILE* out, Rational& total, RollStatistics& stats) {
+        for (long block = 0; block < blocks_; ++block) {
+            BlockResult result;
+            if (threads_.empty()) {
+                result = roll_block(dice_, opt_, stats_, number_, block);
+            } else {
+                std::unique_lock lock(mutex_);
+                auto& slot = slots_[std::size_t(block % window_)];
+                cv_.wait(lock, [&] { return slot.has_value(); });
+                result = std::move(*slot);
+                slot.reset();
+                written_ = block + 1;
+            }
+            cv_.notify_all();
+            if (result.error)
+                std::rethrow_exception(result.error);
+            result.out.flush(out);
+            total += result.total;
+            stats.merge(result.stats);
+        }
+    }
+
+    void BlockRunner::work() {
+        for (;;) {
+            long block = 0;
+            {
+                std::unique_lock lock(mutex_);
+                cv_.wait(lock, [&] { return stop_ || next_ >= blocks_ || next_ < written_ + window_; });
+                if (stop_ || next_ >= blocks_)
+                    return;
+                block = next_++;
             }
+            auto result = roll_block(dice_, opt_, stats_, number_, block);
+            {
+                std::lock_guard lock(mutex_);
+                slots_[std::size_t(block % window_)] = std::move(result);
+            }
+            cv_.notify_all();
+        }
+    }
+
+    // Options are shared by the command line and server requests; requests
+    // can only use the flags that affect a single run
+
+    void parse_options(std::vector<std::string>& args, Options& opt, long& threads, bool& has_seed, bool request) {
+
+        while (! args.empty() && args[0][0] == '-') {
+            auto flags = args[0];
             args.erase(args.begin());
+            if (flags.substr(0, 2) == "--") {
+                if (request)
+                    throw std::invalid_argument("Invalid option in request: " + flags);
+                if (flags == "--show-seed") {
+                    opt.show_seed = true;
+                    continue;
+                }
+                if (flags == "--serve") {
+                    opt.serve = true;
+                    continue;
+                }
+                if (flags != "--seed" && flags != "--stream" && flags != "--offset" && flags != "--socket")
+                    throw std::invalid_argument("Invalid option: " + flags);
+                if (args.empty())
+                    throw std::invalid_argument("No value for " + flags);
+                if (flags == "--socket") {
+                    opt.serve = true;
+                    opt.socket = args[0];
+                    args.erase(args.begin());
+                    continue;
+                }
+                auto value = parse_number(flags.substr(2), args[0]);
+                args.erase(args.begin());
+                if (flags == "--seed") {
+                    opt.seed = value;
+                    has_seed = true;
+                } else if (flags == "--stream") {
+                    opt.stream = value;
+                } else {
+                    opt.offset = value;
+                }
+                continue;
+            }
+            for (std::size_t i = 1; i < flags.size(); ++i) {
+                switch (flags[i]) {
+                    case 'g':  opt.use_grand = true; break;
+                    case 'd':  opt.use_decimal = true; break;
+                    case 'r':  opt.use_round = true; break;
+                    case 'f':  opt.use_floor = true; break;
+                    case 'c':  opt.use_ceil = true; break;
+                    case 'z':  opt.use_zero = true; break;
+                    case 'p':  opt.use_positive = true; break;
+                    case 'b':  opt.use_binary = true; break;
+                    case 's':  opt.use_stats = true; break;
+                    case 'j': {
+                        auto value = flags.substr(i + 1);
+                        if (value.empty() && ! args.empty()) {
+                            value = args[0];
+                            args.erase(args.begin());
+                        }
+                        if (value.empty() || value.size() > 4 || value.find_first_not_of("0123456789") != std::string::npos)
+                            throw std::invalid_argument("Invalid number of threads: " + value);
+                        threads = std::strtol(value.data(), nullptr, 10);
+                        i = flags.size();
+                        break;
+                    }
+                    default:   throw std::invalid_argument("Invalid flags: " + flags);
+                }
+            }
         }
 
-        if (int(use_decimal) + int(use_round) + int(use_floor) + int(use_ceil) > 1)
+        if (int(opt.use_decimal) + int(opt.use_round) + int(opt.use_floor) + int(opt.use_ceil) > 1)
             throw std::invalid_argument("Only one of the -d, -r, -f, and -c flags can be used");
-        if (int(use_zero) + int(use_positive) > 1)
+        if (int(opt.use_zero) + int(opt.use_positive) > 1)
             throw std::invalid_argument("Only one of the -z and -p flags can be used");
+        if (opt.use_binary && opt.use_stats)
+            throw std::invalid_argument("Only one of the -b and -s flags can be used");
+        if (opt.use_binary && opt.serve)
+            throw std::invalid_argument("The -b flag can not be used in server mode");
+        if (threads == 0)
+            threads = std::max(long(std::thread::hardware_concurrency()), 1l);
+
+    }
+
+    long parse_rolls(const std::vector<std::string>& args) {
         if (args.empty())
             throw std::invalid_argument("No dice pattern was supplied");
         if (args.size() > 2)
             throw std::invalid_argument("Too many arguments");
         if (args.size() == 2 && args[1].find_first_not_of("0123456789") != std::string::npos)
             throw std::invalid_argument("Invalid number of rolls: " + args[1]);
-
-        Dice dice(args[0]);
         long number = 1;
         if (args.size() == 2)
             number = std::strtol(args[1].data(), nullptr, 10);
-        auto seed = std::random_device()();
-        std::mt19937 rng(seed);
+        return number;
+    }
+
+    // Write all the results of one run, including statistics and the grand
+    // total; the caller has already checked the range of rolls
+
+    void roll_dice(std::FILE* out, const Dice& dice, const Options& opt, long number, long threads) {
+
         Rational total;
+        auto layout = opt.use_stats ? make_statistics(dice, opt) : RollStatistics();
+        RollStatistics stats;
 
-        for (long i = 1; i <= number; ++i) {
-            auto result = dice(rng);
-            if (use_round)
-                result = result.round();
-            else if (use_floor)
-                result = result.floor();
-            else if (use_ceil)
-                result = result.ceil();
-            if (use_zero && result < 0)
-                result = 0;
-            else if (use_positive && result < 1)
-                result = 1;
-            if (number > 1)
-                std::cout << i << ": ";
-            total += result;
-            if (use_decimal)
-                std::cout << double(result);
+        {
+            BlockRunner runner(dice, opt, layout, number, unsigned(threads));
+            runner.run(out, total, stats);
+        }
+
+        std::ostringstream text;
+
+        if (opt.use_stats) {
+            print_statistics(text, dice, opt, stats);
+        } else if (opt.use_grand && number > 1) {
+            text << "Total: ";
+            if (opt.use_decimal)
+                text << double(total);
             else
-                std::cout << result.mixed();
-            std::cout << "\n";
+                text << total.mixed();
+            text << "\n";
+        }
+
+        // Keep the binary output stream clean
+
+        auto str = text.str();
+        auto file = opt.use_binary ? stderr : out;
+        if (! str.empty() && std::fwrite(str.data(), 1, str.size(), file) != str.size())
+            throw std::runtime_error("Output error");
+
+    }
+
+    // In server mode each line of input is a request, with the same options,
+    // pattern, and number of rolls as the command line. Every complete line
+    // already read is answered before the output is flushed, so a client can
+    // pipeline requests without paying for a write per response. Each
+    // response ends with an empty line. All requests share one cache of
+    // parsed dice, and claim consecutive ranges of roll indices from the
+    // same random sequence.
+
+    class Server {
+    public:
+        Server(const Options& opt, long threads): opt_(opt), threads_(threads), next_(opt.offset) {}
+        void session(int in, std::FILE* out);
+    private:
+        const Options opt_;
+        const long threads_;
+        DiceCache cache_;
+        std::mutex mutex_;
+        uint64_t next_;
+        void respond(std::string_view line, std::FILE* out);
+        uint64_t claim(long number);
+    };
+
+    void Server::session(int in, std::FILE* out) {
+
+        static constexpr std::size_t read_size = 65536;
+
+        std::string pending;
+        std::vector<char> buf(read_size);
+
+        for (;;) {
+            #ifdef _WIN32
+                auto n = ::_read(in, buf.data(), unsigned(read_size));
+            #else
+                auto n = ::read(in, buf.data(), read_size);
+            #endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            pending.append(buf.data(), std::size_t(n));
+            std::size_t start = 0;
+            for (auto end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start)) {
+                respond(std::string_view(pending).substr(start, end - start), out);
+                start = end + 1;
+            }
+            pending.erase(0, start);
+            std::fflush(out);
+        }
+
+        respond(pending, out);
+        std::fflush(out);
+
+    }
+
+    void Server::respond(std::string_view line, std::FILE* out) {
+
+        std::vector<std::string> args;
+        std::size_t i = 0;
+
+        for (;;) {
+            i = line.find_first_not_of(" \t\r", i);
+            if (i == std::string_view::npos)
+                break;
+            auto j = std::min(line.find_first_of(" \t\r", i), line.size());
+            args.emplace_back(line.substr(i, j - i));
+            i = j;
+        }
+
+        if (args.empty())
+            return;
+
+        try {
+            auto opt = opt_;
+            auto threads = threads_;
+            bool has_seed = false;
+            parse_options(args, opt, threads, has_seed, true);
+            auto number = parse_rolls(args);
+            auto cached = cache_.get(args[0]);
+            opt.offset = claim(number);
+            roll_dice(out, cached->dice(), opt, number, threads);
+        }
+
+        catch (const std::exception& ex) {
+            std::fprintf(out, "*** %s\n", ex.what());
+        }
+
+        std::fputc('\n', out);
+
+    }
+
+    uint64_t Server::claim(long number) {
+        std::lock_guard lock(mutex_);
+        if (uint64_t(number) > max_rolls - next_)
+            throw std::invalid_argument("Too many rolls");
+        auto first = next_;
+        next_ += uint64_t(number);
+        return first;
+    }
+
+    // Each connection to the socket is a separate session on its own thread
+
+    void serve_socket(Server& server, const std::string& path) {
+
+        #ifdef _WIN32
+
+            (void)server;
+            throw std::invalid_argument("Unix domain sockets are not supported on this system: " + path);
+
+        #else
+
+            sockaddr_un addr = {};
+            if (path.empty() || path.size() >= sizeof(addr.sun_path))
+                throw std::invalid_argument("Invalid socket path: " + path);
+            addr.sun_family = AF_UNIX;
+            path.copy(addr.sun_path, path.size());
+
+            auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "socket()");
+
+            // Replace a socket left over from an earlier server, but nothing else
+
+            struct stat st;
+            if (::lstat(path.data(), &st) == 0 && S_ISSOCK(st.st_mode))
+                ::unlink(path.data());
+            if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+                throw std::system_error(errno, std::generic_category(), "bind(): " + path);
+            if (::listen(fd, SOMAXCONN) != 0)
+                throw std::system_error(errno, std::generic_category(), "listen(): " + path);
+
+            // A client that disconnects early should not kill the server
+
+            std::signal(SIGPIPE, SIG_IGN);
+
+            for (;;) {
+                auto conn = ::accept(fd, nullptr, nullptr);
+                if (conn < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "accept()");
+                }
+                std::thread([&server, conn] {
+                    auto out = ::fdopen(conn, "w");
+                    if (out == nullptr) {
+                        ::close(conn);
+                        return;
+                    }
+                    try {
+                        server.session(conn, out);
+                    }
+                    catch (...) {}
+                    std::fclose(out);
+                }).detach();
+            }
+
+        #endif
+
+    }
+
+}
+
+int main(int argc, char** argv) {
+
+    try {
+
+        std::vector<std::string> args(argv + 1, argv + argc);
+
+        if (args.empty() || args[0] == "-h" || args[0] == "--help") {
+            std::cout <<
+                "dice [<options>] <pattern> [<number>]\n"
+                "dice [<options>] --serve|--socket <path>\n"
+                "    <options> = One or more of:\n"
+                "        -g = Show grand total\n"
+                "        -d = Show non-integer results as decimal instead of fraction\n"
+                "        -r = Round fractions to the nearest integer\n"
+                "        -f = Round fractions down to an integer (floor)\n"
+                "        -c = Round fractions up to an integer (ceiling)\n"
+                "        -z = Force a non-negative result (results <0 reported as 0)\n"
+                "        -p = Force a positive result (results <1 reported as 1)\n"
+                "        -b = Write binary records (int64 numerator and denominator, or double with -d)\n"
+                "        -s = Show summary statistics instead of individual results\n"
+                "        -j <threads> = Number of threads to use (default 1, 0 = all cores)\n"
+                "        --seed <n> = Random seed (default is random)\n"
+                "        --stream <n> = Random stream (default 0)\n"
+                "        --offset <n> = Index of the first roll (default 0)\n"
+                "        --show-seed = Write the seed to standard error\n"
+                "        --serve = Read requests from standard input\n"
+                "        --socket <path> = Read requests from a Unix domain socket\n"
+                "        -h, --help = Print usage information\n"
+                "    <pattern> = Dice to roll\n"
+                "    <number> = Number of times to roll (default 1)\n";
+            return 0;
+        }
+
+        Options opt;
+        long threads = 1;
+        bool has_seed = false;
+        parse_options(args, opt, threads, has_seed, false);
+        Rational::set_checked(true);
+        std::optional<Dice> dice;
+        long number = 0;
+
+        if (opt.serve) {
+            if (! args.empty())
+                throw std::invalid_argument("Unexpected arguments in server mode");
+        } else {
+            number = parse_rolls(args);
+            dice.emplace(args[0]);
+        }
+
+        if (opt.offset > max_rolls || uint64_t(number) > max_rolls - opt.offset)
+            throw std::invalid_argument("Too many rolls");
+        if (! has_seed) {
+            std::random_device device;
+            opt.seed = (uint64_t(device()) << 32) + device();
         }
+        if (opt.show_seed)
+            std::cerr << "Seed: " << opt.seed << "\n";
 
-        if (use_grand && number > 1) {
-            std::cout << "Total: ";
-            if (use_decimal)
-                std::cout << double(total);
+        if (opt.serve) {
+            Server server(opt, threads);
+            if (opt.socket.empty())
+                server.session(0, stdout);
             else
-                std::cout << total.mixed();
-            std::cout << "\n";
+                serve_socket(server, opt.socket);
+        } else {
+            roll_dice(stdout, *dice, opt, number, threads);
         }
 
         return 0;
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Weights of the possible sums of the highest k of n dice, by dynamic
+// programming over the face values from highest to lowest. Working
+// downwards, the kept dice are always the first k assigned, so the state
+// only needs the number of dice assigned so far and the sum of the kept
+// ones, instead of the full sorted roll.
+//
+// weight(m,c,v) is the weight of exactly c of the m dice not yet assigned
+// showing v, given that all of them show v or less. The function for exact
+// counts is the binomial coefficient C(m,c); for probabilities it is
+// C(m,c)(1/v)^c(1-1/v)^(m-c). multiply_add(acc,x,y) adds x*y to acc.
+//
+// The result is indexed by sum-k, from k to k*faces. The sums for the
+// lowest k of n dice are the same weights in reverse order.
+
+template <typename T, typename WeightFunction, typename MultiplyAddFunction>
+std::vector<T> keep_highest_weights(int64_t n, int64_t faces, int64_t k,
+        WeightFunction weight, MultiplyAddFunction multiply_add) {
+
+    static constexpr double max_work = 2e9;
+
+    if (n < 0 || faces < 1 || k < 0 || k > n)
+        throw std::invalid_argument("Invalid dice");
+    auto n_sums = std::size_t(k * faces + 1);
+    if (double(faces) * double(n + 1) * double(n + 1) * double(n_sums) / 2 > max_work)
+        throw std::length_error("Too many dice for exact statistics");
+
+    auto rows = std::size_t(n + 1);
+    std::vector<T> ways(rows * n_sums, T(0)), next(rows * n_sums, T(0));
+    ways[0] = T(1);
+
+    for (int64_t v = faces; v >= 1; --v) {
+        std::fill(next.begin(), next.end(), T(0));
+        for (int64_t j = 0; j <= n; ++j) {
+            auto m = n - j;
+            auto kept = j < k ? k - j : 0;
+            for (std::size_t s = 0; s < n_sums; ++s) {
+                auto w = ways[std::size_t(j) * n_sums + s];
+                if (w == T(0))
+                    continue;
+                for (int64_t c = 0; c <= m; ++c) {
+                    auto t = s + std::size_t(v * (c < kept ? c : kept));
+                    multiply_add(next[std::size_t(j + c) * n_sums + t], w, weight(m, c, v));
+                }
+            }
+        }
+        ways.swap(next);
+    }
+
+    auto first = ways.begin() + std::ptrdiff_t(std::size_t(n) * n_sums);
+    return std::vector<T>(first + k, first + std::ptrdiff_t(n_sums));
+
+}
@@ -0,0 +1,64 @@
+#include "dice/output-buffer.hpp"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+
+    constexpr std::size_t max_number_size = 32; // Longest integer or %g double
+
+}
+
+void OutputBuffer::write(std::string_view str) {
+    reserve(str.size());
+    std::memcpy(end(), str.data(), str.size());
+    size_ += str.size();
+}
+
+void OutputBuffer::write_integer(integer_type x) {
+    reserve(max_number_size);
+    size_ = std::size_t(std::to_chars(end(), limit(), x).ptr - buf_.data());
+}
+
+// Same format as the default for std::ostream (printf %g)
+
+void OutputBuffer::write_decimal(real_type x) {
+    reserve(max_number_size);
+    size_ = std::size_t(std::to_chars(end(), limit(), x, std::chars_format::general, 6).ptr - buf_.data());
+}
+
+// Same formats as Rational::str() and Rational::mixed()
+
+void OutputBuffer::write_fraction(const Rational& r) {
+    write_integer(r.num());
+    if (r.den() != 1) {
+        write('/');
+        write_integer(r.den());
+    }
+}
+
+void OutputBuffer::write_mixed(const Rational& r) {
+    auto n = r.num(), d = r.den();
+    if (n > - d && n < d) {
+        write_fraction(r);
+        return;
+    }
+    write_integer(r.int_part());
+    auto f = n % d;
+    if (f != 0) {
+        write(' ');
+        write_integer(f < 0 ? - f : f);
+        write('/');
+        write_integer(d);
+    }
+}
+
+void OutputBuffer::flush(std::FILE* file) {
+    if (size_ > 0 && std::fwrite(buf_.data(), 1, size_, file) != size_)
+        throw std::runtime_error("Output error");
+    size_ = 0;
+}
+
+void OutputBuffer::grow(std::size_t n) {
+    buf_.resize(std::max(2 * buf_.size(), size_ + n));
+}
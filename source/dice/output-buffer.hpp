@@ -0,0 +1,47 @@
+#pragma once
+
+#include "dice/rational.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+class OutputBuffer {
+public:
+    using integer_type = int64_t;
+    using real_type = double;
+    static constexpr std::size_t default_capacity = 1 << 20;
+    explicit OutputBuffer(std::size_t capacity = default_capacity): buf_(capacity, '\0') {}
+    void write(char c) { reserve(1); buf_[size_++] = c; }
+    void write(std::string_view str);
+    void write_integer(integer_type x);
+    void write_decimal(real_type x);
+    void write_fraction(const Rational& r);
+    void write_mixed(const Rational& r);
+    template <typename T> void write_binary(const T& t);
+    void write_binary(const Rational& r) { write_binary(r.num()); write_binary(r.den()); }
+    const char* data() const noexcept { return buf_.data(); }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    std::string_view view() const noexcept { return {buf_.data(), size_}; }
+    void clear() noexcept { size_ = 0; }
+    void flush(std::FILE* file);
+private:
+    std::string buf_;
+    std::size_t size_ = 0;
+    char* end() noexcept { return buf_.data() + size_; }
+    char* limit() noexcept { return buf_.data() + buf_.size(); }
+    void reserve(std::size_t n) { if (buf_.size() - size_ < n) grow(n); }
+    void grow(std::size_t n);
+};
+
+template <typename T>
+void OutputBuffer::write_binary(const T& t) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    reserve(sizeof(T));
+    std::memcpy(end(), &t, sizeof(T));
+    size_ += sizeof(T);
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include "dice/rational.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Modifiers applied to a group of dice before summing. Drop modifiers are
+// normalized to the equivalent keep modifier by the parser, and strict
+// success comparisons to the equivalent inclusive one. Rerolled face values
+// are kept sorted, with no duplicates. A success pool counts the dice that
+// meet the target instead of adding them.
+
+struct DiceModifiers {
+    enum class keep_mode { all, highest, lowest };
+    enum class explode_mode { none, explode, compound };
+    enum class success_mode { none, at_least, at_most };
+    static constexpr std::size_t max_rerolls = 8;
+    keep_mode keep = keep_mode::all;
+    int64_t keep_count = 0;
+    explode_mode explode = explode_mode::none;
+    int64_t rerolls[max_rerolls] = {};
+    std::size_t n_rerolls = 0;
+    success_mode success = success_mode::none;
+    int64_t target = 0;
+    constexpr bool is_plain() const noexcept {
+        return keep == keep_mode::all && explode == explode_mode::none
+            && n_rerolls == 0 && success == success_mode::none;
+    }
+    constexpr bool is_rerolled(int64_t face) const noexcept;
+    constexpr bool add_reroll(int64_t face) noexcept;
+};
+
+constexpr bool DiceModifiers::is_rerolled(int64_t face) const noexcept {
+    for (std::size_t i = 0; i < n_rerolls; ++i)
+        if (rerolls[i] == face)
+            return true;
+    return false;
+}
+
+// Returns false if there are too many rerolled values
+
+constexpr bool DiceModifiers::add_reroll(int64_t face) noexcept {
+    if (is_rerolled(face))
+        return true;
+    if (n_rerolls == max_rerolls)
+        return false;
+    auto i = n_rerolls++;
+    for (; i > 0 && rerolls[i - 1] > face; --i)
+        rerolls[i] = rerolls[i - 1];
+    rerolls[i] = face;
+    return true;
+}
+
+constexpr bool operator==(const DiceModifiers& lhs, const DiceModifiers& rhs) noexcept {
+    if (lhs.keep != rhs.keep || lhs.keep_count != rhs.keep_count
+            || lhs.explode != rhs.explode || lhs.n_rerolls != rhs.n_rerolls
+            || lhs.success != rhs.success || lhs.target != rhs.target)
+        return false;
+    for (std::size_t i = 0; i < lhs.n_rerolls; ++i)
+        if (lhs.rerolls[i] != rhs.rerolls[i])
+            return false;
+    return true;
+}
+
+constexpr bool operator!=(const DiceModifiers& lhs, const DiceModifiers& rhs) noexcept { return ! (lhs == rhs); }
+
+// Total order used to give modified groups a canonical order. Plain dice
+// come first; rerolled face lists are compared lexicographically.
+
+constexpr bool operator<(const DiceModifiers& lhs, const DiceModifiers& rhs) noexcept {
+    if (lhs.keep != rhs.keep)
+        return lhs.keep < rhs.keep;
+    if (lhs.keep_count != rhs.keep_count)
+        return lhs.keep_count < rhs.keep_count;
+    if (lhs.explode != rhs.explode)
+        return lhs.explode < rhs.explode;
+    for (std::size_t i = 0; i < lhs.n_rerolls && i < rhs.n_rerolls; ++i)
+        if (lhs.rerolls[i] != rhs.rerolls[i])
+            return lhs.rerolls[i] < rhs.rerolls[i];
+    if (lhs.n_rerolls != rhs.n_rerolls)
+        return lhs.n_rerolls < rhs.n_rerolls;
+    if (lhs.success != rhs.success)
+        return lhs.success < rhs.success;
+    return lhs.target < rhs.target;
+}
+
+// Single pass scanner for dice patterns. White space is ignored everywhere,
+// including inside numbers, and letters are case insensitive. Positions in
+// error messages refer to the original string. Everything except error
+// reporting is constexpr, so a pattern can be parsed at compile time.
+
+class DiceScanner {
+public:
+    using integer_type = int64_t;
+    constexpr explicit DiceScanner(std::string_view str) noexcept: str_(str) { skip(); }
+    constexpr bool done() const noexcept { return pos_ == str_.size(); }
+    constexpr std::size_t pos() const noexcept { return pos_; }
+    constexpr void reset(std::size_t pos) noexcept { pos_ = pos; }
+    constexpr bool accept(char c) noexcept;
+    constexpr bool accept_multiply() noexcept { return accept('*') || accept('x'); }
+    constexpr bool number(integer_type& n) noexcept;
+    [[noreturn]] void fail() const;
+private:
+    std::string_view str_;
+    std::size_t pos_ = 0;
+    constexpr char peek() const noexcept;
+    constexpr void skip() noexcept;
+};
+
+constexpr bool DiceScanner::accept(char c) noexcept {
+    if (peek() != c)
+        return false;
+    ++pos_;
+    skip();
+    return true;
+}
+
+// Reads a decimal integer, saturating on overflow; returns false, leaving n
+// unchanged, if there are no digits
+
+constexpr bool DiceScanner::number(integer_type& n) noexcept {
+    constexpr auto max = std::numeric_limits<integer_type>::max();
+    if (peek() < '0' || peek() > '9')
+        return false;
+    integer_type x = 0;
+    for (auto c = peek(); c >= '0' && c <= '9'; c = peek()) {
+        integer_type d = c - '0';
+        x = x > (max - d) / 10 ? max : 10 * x + d;
+        ++pos_;
+        skip();
+    }
+    n = x;
+    return true;
+}
+
+inline void DiceScanner::fail() const {
+    std::string message = "Invalid dice at ";
+    if (done())
+        message += "end";
+    else
+        message += "offset " + std::to_string(pos_);
+    message += ": \"" + std::string(str_) + "\"";
+    throw std::invalid_argument(message);
+}
+
+constexpr char DiceScanner::peek() const noexcept {
+    if (done())
+        return '\0';
+    auto c = str_[pos_];
+    return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+constexpr void DiceScanner::skip() noexcept {
+    constexpr std::string_view whitespace = "\t\n\f\r ";
+    while (pos_ < str_.size() && whitespace.find(str_[pos_]) != std::string_view::npos)
+        ++pos_;
+}
+
+// Keep or drop modifier: khN or kN (keep highest), klN (keep lowest), dhN
+// (drop highest), dlN (drop lowest). Returns false if there is no keep or
+// drop modifier here.
+
+constexpr bool parse_keep(DiceScanner& scan, DiceScanner::integer_type n_dice, DiceModifiers& mods) {
+    using keep_mode = DiceModifiers::keep_mode;
+    bool keep = scan.accept('k');
+    if (! keep && ! scan.accept('d'))
+        return false;
+    bool high = true;
+    if (scan.accept('l'))
+        high = false;
+    else if (! scan.accept('h') && ! keep)
+        scan.fail();
+    DiceScanner::integer_type count = 0;
+    if (mods.keep != keep_mode::all || ! scan.number(count) || count > n_dice)
+        scan.fail();
+    if (keep) {
+        mods.keep = high ? keep_mode::highest : keep_mode::lowest;
+        mods.keep_count = count;
+    } else {
+        mods.keep = high ? keep_mode::lowest : keep_mode::highest;
+        mods.keep_count = n_dice - count;
+    }
+    return true;
+}
+
+// Success pool target: >=N, >N, <=N, or <N. Returns false if there is no
+// comparison here.
+
+constexpr bool parse_success(DiceScanner& scan, DiceModifiers& mods) {
+    using success_mode = DiceModifiers::success_mode;
+    int64_t adjust = 0;
+    bool repeated = mods.success != success_mode::none;
+    if (scan.accept('>')) {
+        mods.success = success_mode::at_least;
+        adjust = scan.accept('=') ? 0 : 1;
+    } else if (scan.accept('<')) {
+        mods.success = success_mode::at_most;
+        adjust = scan.accept('=') ? 0 : -1;
+    } else {
+        return false;
+    }
+    DiceScanner::integer_type target = 0;
+    if (repeated || ! scan.number(target) || target == std::numeric_limits<DiceScanner::integer_type>::max())
+        scan.fail();
+    mods.target = target + adjust;
+    return true;
+}
+
+// Modifiers following the number of faces, in any order: ! (exploding),
+// !! (compounding), rN (reroll N, may be repeated), keep or drop, and a
+// success target. Explosions and rerolls apply to every roll of a die,
+// including the extra rolls from an explosion. Exploding dice add extra dice
+// to the group, so they can not be combined with keep or drop; compounding
+// dice can. A success pool can only be combined with rerolls.
+
+constexpr void parse_modifiers(DiceScanner& scan, DiceScanner::integer_type n_dice,
+        DiceScanner::integer_type n_faces, DiceModifiers& mods) {
+    using explode_mode = DiceModifiers::explode_mode;
+    for (;;) {
+        if (scan.accept('!')) {
+            if (mods.explode != explode_mode::none)
+                scan.fail();
+            mods.explode = scan.accept('!') ? explode_mode::compound : explode_mode::explode;
+        } else if (scan.accept('r')) {
+            DiceScanner::integer_type face = 0;
+            if (! scan.number(face) || face < 1 || face > n_faces || ! mods.add_reroll(face))
+                scan.fail();
+        } else if (! parse_success(scan, mods) && ! parse_keep(scan, n_dice, mods)) {
+            break;
+        }
+    }
+    // Every face rerolled, an explosion that can never stop, exploding dice
+    // with keep, or a success pool with anything except rerolls
+    auto left = n_faces - DiceScanner::integer_type(mods.n_rerolls);
+    bool pool = mods.success != DiceModifiers::success_mode::none;
+    if ((mods.n_rerolls > 0 && left == 0)
+            || (mods.explode != explode_mode::none && left == 1 && ! mods.is_rerolled(n_faces))
+            || (mods.explode == explode_mode::explode && mods.keep != DiceModifiers::keep_mode::all)
+            || (pool && (mods.explode != explode_mode::none || mods.keep != DiceModifiers::keep_mode::all)))
+        scan.fail();
+}
+
+// Parse a dice pattern, calling add_dice(n,faces,factor,modifiers) for each
+// group of dice and add_modifier(r) for each constant term
+
+template <typename DiceFunction, typename ModifierFunction>
+constexpr void parse_dice(std::string_view str, DiceFunction add_dice, ModifierFunction add_modifier) {
+    using integer_type = DiceScanner::integer_type;
+    DiceScanner scan(str);
+    for (bool first = true; ! scan.done(); first = false) {
+        integer_type sign = 1;
+        if (scan.accept('-'))
+            sign = -1;
+        else if (! scan.accept('+') && ! first)
+            scan.fail();
+        integer_type number = 1, factor1 = 1, n_dice = 1, n_faces = 6, factor2 = 1, divisor = 1;
+        bool has_number = scan.number(number);
+        bool is_dice = false;
+        auto mark = scan.pos();
+        if (has_number && scan.accept_multiply()) {
+            scan.number(n_dice);
+            if (scan.accept('d')) {
+                factor1 = number;
+                is_dice = true;
+            } else {
+                n_dice = 1;
+                scan.reset(mark);
+            }
+        }
+        if (! is_dice && scan.accept('d')) {
+            n_dice = number;
+            is_dice = true;
+        }
+        DiceModifiers mods;
+        if (is_dice) {
+            scan.number(n_faces);
+            parse_modifiers(scan, n_dice, n_faces, mods);
+            mark = scan.pos();
+            if (! scan.accept_multiply() || ! scan.number(factor2))
+                scan.reset(mark);
+        } else if (! has_number) {
+            scan.fail();
+        }
+        mark = scan.pos();
+        if (! scan.accept('/') || ! scan.number(divisor))
+            scan.reset(mark);
+        if (is_dice)
+            add_dice(n_dice, n_faces, Rational(sign * factor1 * factor2, divisor), mods);
+        else
+            add_modifier(Rational(sign * number, divisor));
+    }
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+// All of the functions here depend only on the sequence of values returned
+// by the engine, never on the standard library implementation, so a given
+// engine state produces the same results on every platform.
+
+// Number of uniform bits available from one engine call: the largest k for
+// which 2^k-1 fits in the engine's range
+
+template <typename RNG>
+constexpr int random_engine_bits() noexcept {
+    auto range = uint64_t(RNG::max()) - uint64_t(RNG::min());
+    int k = 1;
+    for (uint64_t mask = 1; k < 64 && (mask << 1 | 1) <= range; ++k)
+        mask = mask << 1 | 1;
+    return k;
+}
+
+// One engine call reduced to random_engine_bits() uniform bits; values
+// outside the largest power of two range are rejected
+
+template <typename RNG>
+uint64_t random_engine_call(RNG& rng) {
+    constexpr int k = random_engine_bits<RNG>();
+    constexpr uint64_t mask = k == 64 ? ~ uint64_t(0) : (uint64_t(1) << (k % 64)) - 1;
+    for (;;) {
+        auto x = uint64_t(rng()) - uint64_t(RNG::min());
+        if (x <= mask)
+            return x;
+    }
+}
+
+// Uniform 32 or 64 bit unsigned integers
+
+template <typename RNG>
+uint32_t random_bits32(RNG& rng) {
+    constexpr int k = random_engine_bits<RNG>();
+    if constexpr (k >= 32) {
+        return uint32_t(random_engine_call(rng));
+    } else {
+        uint64_t x = 0;
+        for (int n = 0; n < 32; n += k)
+            x = (x << k) | random_engine_call(rng);
+        return uint32_t(x);
+    }
+}
+
+template <typename RNG>
+uint64_t random_bits64(RNG& rng) {
+    constexpr int k = random_engine_bits<RNG>();
+    if constexpr (k == 64) {
+        return random_engine_call(rng);
+    } else {
+        uint64_t x = 0;
+        for (int n = 0; n < 64; n += k)
+            x = (x << k) | random_engine_call(rng);
+        return x;
+    }
+}
+
+// Uniform real number in [0,1)
+
+template <typename RNG>
+double random_unit(RNG& rng) {
+    return double(random_bits64(rng) >> 11) * 0x1p-53;
+}
+
+// Standard normal distribution (Box-Muller)
+
+template <typename RNG>
+double random_normal(RNG& rng) {
+    static const double pi = std::acos(-1.0);
+    auto u = 1 - random_unit(rng);
+    auto v = random_unit(rng);
+    return std::sqrt(-2 * std::log(u)) * std::cos(2 * pi * v);
+}
+
+// Uniform integer in [a,b], using Lemire's nearly divisionless method: the
+// random bits are multiplied by the size of the range and the high half
+// taken as the result, with a division only needed in the rare cases where
+// the low half falls close enough to zero that it might need rejecting.
+
+class UniformInteger {
+public:
+    using integer_type = int64_t;
+    UniformInteger() = default;
+    UniformInteger(integer_type a, integer_type b);
+    template <typename RNG> integer_type operator()(RNG& rng) const;
+    integer_type a() const noexcept { return a_; }
+    integer_type b() const noexcept { return b_; }
+private:
+    integer_type a_ = 0;
+    integer_type b_ = 0;
+    uint64_t range_ = 0; // b-a
+    static uint64_t mul128(uint64_t x, uint64_t y, uint64_t& low) noexcept;
+};
+
+inline UniformInteger::UniformInteger(integer_type a, integer_type b):
+a_(a), b_(b), range_(uint64_t(b) - uint64_t(a)) {
+    if (a > b)
+        throw std::invalid_argument("Invalid integer range");
+}
+
+template <typename RNG>
+UniformInteger::integer_type UniformInteger::operator()(RNG& rng) const {
+    uint64_t x;
+    if (range_ == 0) {
+        x = 0;
+    } else if (range_ < UINT32_MAX) {
+        auto s = uint32_t(range_ + 1);
+        auto m = uint64_t(random_bits32(rng)) * s;
+        if (uint32_t(m) < s) {
+            auto t = uint32_t(- s) % s;
+            while (uint32_t(m) < t)
+                m = uint64_t(random_bits32(rng)) * s;
+        }
+        x = m >> 32;
+    } else if (range_ == UINT32_MAX) {
+        x = random_bits32(rng);
+    } else if (range_ < UINT64_MAX) {
+        auto s = range_ + 1;
+        uint64_t low;
+        x = mul128(random_bits64(rng), s, low);
+        if (low < s) {
+            auto t = (- s) % s;
+            while (low < t)
+                x = mul128(random_bits64(rng), s, low);
+        }
+    } else {
+        x = random_bits64(rng);
+    }
+    return integer_type(uint64_t(a_) + x);
+}
+
+// Full 128 bit product, returning the high half
+
+inline uint64_t UniformInteger::mul128(uint64_t x, uint64_t y, uint64_t& low) noexcept {
+    auto x0 = x & 0xffff'ffff, x1 = x >> 32;
+    auto y0 = y & 0xffff'ffff, y1 = y >> 32;
+    auto p00 = x0 * y0, p01 = x0 * y1, p10 = x1 * y0, p11 = x1 * y1;
+    auto mid = (p00 >> 32) + (p01 & 0xffff'ffff) + (p10 & 0xffff'ffff);
+    low = (mid << 32) | (p00 & 0xffff'ffff);
+    return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+
+// Binomial distribution: the number of successes in n trials with
+// probability p. Small means (n*min(p,1-p)<10) use sequential inversion;
+// larger ones use Hormann's BTRD algorithm (transformed rejection with
+// decomposition), with an expected cost bounded independently of n. Either
+// way, p>1/2 is handled by counting failures instead.
+
+class BinomialInteger {
+public:
+    using integer_type = int64_t;
+    BinomialInteger() = default;
+    BinomialInteger(integer_type n, double p);
+    template <typename RNG> integer_type operator()(RNG& rng) const;
+    integer_type n() const noexcept { return n_; }
+    double p() const noexcept { return p_; }
+private:
+    static constexpr double btrd_min = 10;
+    integer_type n_ = 0;
+    double p_ = 0;
+    bool flip_ = false; // Count failures
+    bool btrd_ = false;
+    double r_ = 0; // p/q (using the smaller of p and q)
+    double q_n_ = 0; // q^n, for inversion
+    double nr_ = 0, npq_ = 0, a_ = 0, b_ = 0, c_ = 0, alpha_ = 0, v_r_ = 0, u_rv_r_ = 0; // BTRD
+    integer_type m_ = 0; // Mode
+    static double stirling_tail(integer_type k) noexcept;
+    template <typename RNG> integer_type inversion(RNG& rng) const;
+    template <typename RNG> integer_type btrd(RNG& rng) const;
+};
+
+inline BinomialInteger::BinomialInteger(integer_type n, double p):
+n_(n), p_(p) {
+    if (n < 0 || ! (p >= 0 && p <= 1))
+        throw std::invalid_argument("Invalid binomial distribution");
+    flip_ = p > 0.5;
+    if (flip_)
+        p = 1 - p;
+    auto q = 1 - p;
+    r_ = p / q;
+    btrd_ = double(n) * p >= btrd_min;
+    if (! btrd_) {
+        q_n_ = std::pow(q, double(n));
+        return;
+    }
+    auto spq = std::sqrt(double(n) * p * q);
+    b_ = 1.15 + 2.53 * spq;
+    a_ = -0.0873 + 0.0248 * b_ + 0.01 * p;
+    c_ = double(n) * p + 0.5;
+    alpha_ = (2.83 + 5.1 / b_) * spq;
+    v_r_ = 0.92 - 4.2 / b_;
+    u_rv_r_ = 0.86 * v_r_;
+    m_ = integer_type(std::floor(double(n + 1) * p));
+    nr_ = double(n + 1) * r_;
+    npq_ = double(n) * p * q;
+}
+
+template <typename RNG>
+BinomialInteger::integer_type BinomialInteger::operator()(RNG& rng) const {
+    if (n_ == 0 || p_ == 0)
+        return 0;
+    if (p_ == 1)
+        return n_;
+    auto x = btrd_ ? btrd(rng) : inversion(rng);
+    return flip_ ? n_ - x : x;
+}
+
+// Stirling series remainder: log(k!) - [(k+1/2)log(k+1) - (k+1) + log(2pi)/2]
+
+inline double BinomialInteger::stirling_tail(integer_type k) noexcept {
+    static constexpr double table[] = {
+        0.08106146679532726, 0.04134069595540929, 0.02767792568499834, 0.02079067210376509,
+        0.01664469118982119, 0.01387612882307075, 0.01189670994589177, 0.01041126526197209,
+        0.009255462182712733, 0.008330563433362871,
+    };
+    if (k < 10)
+        return table[k];
+    auto r = 1 / double(k + 1);
+    auto r2 = r * r;
+    return r * (1.0 / 12 - r2 * (1.0 / 360 - r2 / 1260));
+}
+
+template <typename RNG>
+BinomialInteger::integer_type BinomialInteger::inversion(RNG& rng) const {
+    for (;;) {
+        auto u = random_unit(rng);
+        auto f = q_n_;
+        integer_type x = 0;
+        while (u > f) {
+            u -= f;
+            ++x;
+            if (x > n_)
+                break;
+            f *= (double(n_ - x + 1) / double(x)) * r_;
+        }
+        if (x <= n_)
+            return x;
+    }
+}
+
+template <typename RNG>
+BinomialInteger::integer_type BinomialInteger::btrd(RNG& rng) const {
+    for (;;) {
+        auto v = random_unit(rng);
+        double u;
+        if (v <= u_rv_r_) {
+            u = v / v_r_ - 0.43;
+            return integer_type(std::floor((2 * a_ / (0.5 - std::abs(u)) + b_) * u + c_));
+        }
+        if (v >= v_r_) {
+            u = random_unit(rng) - 0.5;
+        } else {
+            u = v / v_r_ - 0.93;
+            u = (u < 0 ? -0.5 : 0.5) - u;
+            v = random_unit(rng) * v_r_;
+        }
+        auto us = 0.5 - std::abs(u);
+        auto kr = std::floor((2 * a_ / us + b_) * u + c_);
+        if (kr < 0 || kr > double(n_))
+            continue;
+        auto k = integer_type(kr);
+        v = v * alpha_ / (a_ / (us * us) + b_);
+        auto km = double(k > m_ ? k - m_ : m_ - k);
+        if (km <= 15) {
+            // Recursive evaluation of f(k)/f(m)
+            double f = 1;
+            if (m_ < k) {
+                for (auto i = m_ + 1; i <= k; ++i)
+                    f *= nr_ / double(i) - r_;
+            } else {
+                for (auto i = k + 1; i <= m_; ++i)
+                    v *= nr_ / double(i) - r_;
+            }
+            if (v <= f)
+                return k;
+            continue;
+        }
+        // Squeeze, then the full log acceptance test
+        v = std::log(v);
+        auto rho = (km / npq_) * (((km / 3 + 0.625) * km + 1.0 / 6) / npq_ + 0.5);
+        auto t = - km * km / (2 * npq_);
+        if (v < t - rho)
+            return k;
+        if (v > t + rho)
+            continue;
+        auto nm = double(n_ - m_ + 1);
+        auto h = (double(m_) + 0.5) * std::log(double(m_ + 1) / (r_ * nm)) + stirling_tail(m_) + stirling_tail(n_ - m_);
+        auto nk = double(n_ - k + 1);
+        if (v <= h + double(n_ + 1) * std::log(nm / nk) + (double(k) + 0.5) * std::log(nk * r_ / double(k + 1))
+                - stirling_tail(k) - stirling_tail(n_ - k))
+            return k;
+    }
+}
+
+// Philox4x32-10 counter based generator (Salmon et al. 2011). Each 128 bit
+// block of output is a keyed bijection of its position, so any point in
+// the sequence can be reached in constant time, and different streams (the
+// upper half of the counter) never overlap.
+
+class Philox {
+public:
+    using result_type = uint32_t;
+    using block_type = std::array<uint32_t, 4>;
+    Philox() noexcept: Philox(0) {}
+    explicit Philox(uint64_t seed, uint64_t stream = 0) noexcept: seed_(seed), stream_(stream) {}
+    result_type operator()() noexcept;
+    void discard(unsigned long long n) noexcept { pos_ += n; stale_ = true; }
+    void seek(uint64_t pos) noexcept { pos_ = pos; stale_ = true; }
+    uint64_t tell() const noexcept { return pos_; }
+    uint64_t seed() const noexcept { return seed_; }
+    uint64_t stream() const noexcept { return stream_; }
+    static constexpr result_type min() noexcept { return 0; }
+    static constexpr result_type max() noexcept { return UINT32_MAX; }
+    static constexpr block_type generate(block_type counter, uint64_t key) noexcept;
+private:
+    uint64_t seed_;
+    uint64_t stream_;
+    uint64_t pos_ = 0; // Position in 32 bit words
+    block_type buffer_ = {};
+    bool stale_ = true;
+};
+
+inline Philox::result_type Philox::operator()() noexcept {
+    if ((pos_ & 3) == 0 || stale_) {
+        auto block = pos_ >> 2;
+        buffer_ = generate({uint32_t(block), uint32_t(block >> 32), uint32_t(stream_), uint32_t(stream_ >> 32)}, seed_);
+        stale_ = false;
+    }
+    return buffer_[pos_++ & 3];
+}
+
+constexpr Philox::block_type Philox::generate(block_type counter, uint64_t key) noexcept {
+    constexpr uint32_t m0 = 0xd251'1f53, m1 = 0xcd9e'8d57;
+    constexpr uint32_t w0 = 0x9e37'79b9, w1 = 0xbb67'ae85;
+    auto& c = counter;
+    auto k0 = uint32_t(key), k1 = uint32_t(key >> 32);
+    for (int round = 0; round < 10; ++round) {
+        auto p0 = uint64_t(m0) * c[0], p1 = uint64_t(m1) * c[2];
+        c = {uint32_t(p1 >> 32) ^ c[1] ^ k0, uint32_t(p1), uint32_t(p0 >> 32) ^ c[3] ^ k1, uint32_t(p0)};
+        k0 += w0;
+        k1 += w1;
+    }
+    return c;
+}
@@ -1,26 +1,12 @@
 #include "dice/rational.hpp"
-#include <cmath>
+#include <atomic>
 #include <cstdlib>
-#include <numeric>
 #include <stdexcept>
 
-Rational::Rational(integer_type num, integer_type den):
-num_(num), den_(den) {
-    if (den_ == 0)
-        throw std::invalid_argument("Division by zero");
-    normalize();
-}
+namespace {
 
-Rational Rational::frac_part() const noexcept {
-    Rational r = *this;
-    r.num_ %= den_;
-    return r;
-}
+    std::atomic<bool> checked_mode {false};
 
-Rational Rational::abs() const noexcept {
-    auto r = *this;
-    r.num_ = std::abs(r.num_);
-    return r;
 }
 
 std::string Rational::str() const {
@@ -42,98 +28,14 @@ std::string Rational::mixed() const {
     return s;
 }
 
-Rational::integer_type Rational::round() const noexcept {
-    auto i = int_part();
-    auto f2 = 2 * frac_part();
-    if (f2 >= 1)
-        ++i;
-    else if (f2 < -1)
-        --i;
-    return i;
-}
-
-Rational::integer_type Rational::floor() const noexcept {
-    auto i = int_part();
-    auto f = frac_part();
-    if (f < 0)
-        --i;
-    return i;
-}
-
-Rational::integer_type Rational::ceil() const noexcept {
-    auto i = int_part();
-    auto f = frac_part();
-    if (f > 0)
-        ++i;
-    return i;
-}
-
-void Rational::normalize() noexcept {
-    if (den_ < 0) {
-        num_ = - num_;
-        den_ = - den_;
-    }
-    auto gcd = std::gcd(num_, den_);
-    num_ /= gcd;
-    den_ /= gcd;
-}
-
-Rational Rational::operator-() const noexcept {
-    auto r = *this;
-    r.num_ = - r.num_;
-    return r;
-}
-
-Rational& Rational::operator+=(const Rational& rhs) noexcept {
-    auto lcm = std::lcm(den_, rhs.den_);
-    num_ = num_ * (lcm / den_) + rhs.num_ * (lcm / rhs.den_);
-    den_ = lcm;
-    normalize();
-    return *this;
-}
-
-Rational& Rational::operator*=(const Rational& rhs) noexcept {
-    auto n = num_ * rhs.num_;
-    den_ *= rhs.den_;
-    num_ = n;
-    normalize();
-    return *this;
-}
-
-Rational& Rational::operator/=(const Rational& rhs) {
-    *this = {num_ * rhs.den_, den_ * rhs.num_};
-    return *this;
-}
-
-Rational operator+(const Rational& lhs, const Rational& rhs) noexcept {
-    Rational r = lhs;
-    r += rhs;
-    return r;
-}
-
-Rational operator-(const Rational& lhs, const Rational& rhs) noexcept {
-    Rational r = lhs;
-    r -= rhs;
-    return r;
-}
-
-Rational operator*(const Rational& lhs, const Rational& rhs) noexcept {
-    Rational r = lhs;
-    r *= rhs;
-    return r;
-}
-
-Rational operator/(const Rational& lhs, const Rational& rhs) {
-    Rational r = lhs;
-    r /= rhs;
-    return r;
+bool Rational::checked() noexcept {
+    return checked_mode.load(std::memory_order_relaxed);
 }
 
-bool operator==(const Rational& lhs, const Rational& rhs) noexcept {
-    return lhs.num() == rhs.num() && lhs.den() == rhs.den();
+void Rational::set_checked(bool flag) noexcept {
+    checked_mode.store(flag, std::memory_order_relaxed);
 }
 
-bool operator<(const Rational& lhs, const Rational& rhs) noexcept {
-    auto lcm = std::lcm(lhs.den(), rhs.den());
-    return lhs.num() * (lcm / lhs.den()) < rhs.num() * (lcm / rhs.den());
+void Rational::overflow() {
+    throw std::overflow_error("Rational overflow");
 }
@@ -2,52 +2,218 @@
 
 #include <cstdint>
 #include <ostream>
+#include <stdexcept>
 #include <string>
 
 class Rational {
 public:
     using integer_type = int64_t;
     using real_type = double;
-    Rational() = default;
-    Rational(integer_type n) noexcept: num_(n), den_(1) {}
-    Rational(integer_type num, integer_type den);
-    integer_type num() const noexcept { return num_; }
-    integer_type den() const noexcept { return den_; }
-    integer_type int_part() const noexcept { return num_ / den_; }
-    Rational frac_part() const noexcept;
-    Rational abs() const noexcept;
-    int sign() const noexcept { return num_ < 0 ? -1 : num_ > 0 ? 1 : 0; }
+    constexpr Rational() = default;
+    constexpr Rational(integer_type n) noexcept: num_(n), den_(1) {}
+    constexpr Rational(integer_type num, integer_type den);
+    constexpr integer_type num() const noexcept { return num_; }
+    constexpr integer_type den() const noexcept { return den_; }
+    constexpr integer_type int_part() const noexcept { return num_ / den_; }
+    constexpr Rational frac_part() const noexcept;
+    constexpr Rational abs() const { return num_ < 0 ? - *this : *this; }
+    constexpr int sign() const noexcept { return num_ < 0 ? -1 : num_ > 0 ? 1 : 0; }
     std::string str() const;
     std::string mixed() const;
-    integer_type round() const noexcept;
-    integer_type floor() const noexcept;
-    integer_type ceil() const noexcept;
-    explicit operator bool() const noexcept { return num_ != 0; }
-    explicit operator real_type() const noexcept { return real_type(num_) / real_type(den_); }
-    Rational operator+() const noexcept { return *this; }
-    Rational operator-() const noexcept;
-    Rational& operator++() noexcept { return *this += 1; }
-    Rational operator++(int) noexcept { auto r = *this; ++*this; return r; }
-    Rational& operator--() noexcept { return *this -= 1; }
-    Rational operator--(int) noexcept { auto r = *this; --*this; return r; }
-    Rational& operator+=(const Rational& rhs) noexcept;
-    Rational& operator-=(const Rational& rhs) noexcept { return *this += - rhs; }
-    Rational& operator*=(const Rational& rhs) noexcept;
-    Rational& operator/=(const Rational& rhs);
+    constexpr integer_type round() const noexcept;
+    constexpr integer_type floor() const noexcept;
+    constexpr integer_type ceil() const noexcept;
+    constexpr explicit operator bool() const noexcept { return num_ != 0; }
+    constexpr explicit operator real_type() const noexcept { return real_type(num_) / real_type(den_); }
+    constexpr Rational operator+() const noexcept { return *this; }
+    constexpr Rational operator-() const;
+    constexpr Rational& operator++() { return *this += 1; }
+    constexpr Rational operator++(int) { auto r = *this; ++*this; return r; }
+    constexpr Rational& operator--() { return *this -= 1; }
+    constexpr Rational operator--(int) { auto r = *this; --*this; return r; }
+    constexpr Rational& operator+=(const Rational& rhs);
+    constexpr Rational& operator-=(const Rational& rhs);
+    constexpr Rational& operator*=(const Rational& rhs);
+    constexpr Rational& operator/=(const Rational& rhs);
+    static bool checked() noexcept;
+    static void set_checked(bool flag) noexcept;
 private:
+    __extension__ using wide_type = __int128;
+    __extension__ using unsigned_wide = unsigned __int128;
     integer_type num_ = 0;
     integer_type den_ = 1;
-    void normalize() noexcept;
+    constexpr void assign(wide_type num, wide_type den);
+    constexpr void add_fraction(const Rational& rhs, integer_type sign);
+    constexpr void multiply_fraction(const Rational& rhs);
+    static constexpr bool fits(wide_type x) noexcept { return x >= INT64_MIN && x <= INT64_MAX; }
+    template <typename T> static constexpr int count_trailing_zeros(T x) noexcept;
+    template <typename T> static constexpr T binary_gcd(T x, T y) noexcept;
+    [[noreturn]] static void overflow();
 };
 
-Rational operator+(const Rational& lhs, const Rational& rhs) noexcept;
-Rational operator-(const Rational& lhs, const Rational& rhs) noexcept;
-Rational operator*(const Rational& lhs, const Rational& rhs) noexcept;
-Rational operator/(const Rational& lhs, const Rational& rhs);
-bool operator==(const Rational& lhs, const Rational& rhs) noexcept;
-inline bool operator!=(const Rational& lhs, const Rational& rhs) noexcept { return ! (lhs == rhs); }
-bool operator<(const Rational& lhs, const Rational& rhs) noexcept;
-inline bool operator>(const Rational& lhs, const Rational& rhs) noexcept { return rhs < lhs; }
-inline bool operator<=(const Rational& lhs, const Rational& rhs) noexcept { return ! (rhs < lhs); }
-inline bool operator>=(const Rational& lhs, const Rational& rhs) noexcept { return ! (lhs < rhs); }
+constexpr Rational::Rational(integer_type num, integer_type den) {
+    if (den == 0)
+        throw std::invalid_argument("Division by zero");
+    assign(num, den);
+}
+
+constexpr Rational Rational::frac_part() const noexcept {
+    Rational r = *this;
+    r.num_ %= den_;
+    return r;
+}
+
+constexpr Rational::integer_type Rational::round() const noexcept {
+    auto n = 2 * wide_type(num_) + den_;
+    auto d = 2 * wide_type(den_);
+    auto q = n / d;
+    if (n % d < 0)
+        --q;
+    return integer_type(q);
+}
+
+constexpr Rational::integer_type Rational::floor() const noexcept {
+    auto q = num_ / den_;
+    if (num_ % den_ < 0)
+        --q;
+    return q;
+}
+
+constexpr Rational::integer_type Rational::ceil() const noexcept {
+    auto q = num_ / den_;
+    if (num_ % den_ > 0)
+        ++q;
+    return q;
+}
+
+constexpr Rational Rational::operator-() const {
+    Rational r;
+    r.assign(- wide_type(num_), den_);
+    return r;
+}
+
+// Integer operands skip the gcd entirely, unless the result overflows
+
+constexpr Rational& Rational::operator+=(const Rational& rhs) {
+    integer_type n = 0;
+    if (den_ == 1 && rhs.den_ == 1 && ! __builtin_add_overflow(num_, rhs.num_, &n))
+        num_ = n;
+    else
+        add_fraction(rhs, 1);
+    return *this;
+}
+
+constexpr Rational& Rational::operator-=(const Rational& rhs) {
+    integer_type n = 0;
+    if (den_ == 1 && rhs.den_ == 1 && ! __builtin_sub_overflow(num_, rhs.num_, &n))
+        num_ = n;
+    else
+        add_fraction(rhs, -1);
+    return *this;
+}
+
+constexpr Rational& Rational::operator*=(const Rational& rhs) {
+    integer_type n = 0;
+    if (den_ == 1 && rhs.den_ == 1 && ! __builtin_mul_overflow(num_, rhs.num_, &n))
+        num_ = n;
+    else
+        multiply_fraction(rhs);
+    return *this;
+}
+
+constexpr Rational& Rational::operator/=(const Rational& rhs) {
+    if (rhs.num_ == 0)
+        throw std::invalid_argument("Division by zero");
+    assign(wide_type(num_) * rhs.den_, wide_type(den_) * rhs.num_);
+    return *this;
+}
+
+// Reduce a fraction calculated in 128 bits and narrow it back to 64. The
+// common case, where both parts already fit, takes the 64 bit gcd; results
+// that still do not fit after reduction are an overflow.
+
+constexpr void Rational::assign(wide_type num, wide_type den) {
+    if (den < 0) {
+        num = - num;
+        den = - den;
+    }
+    if (fits(num) && fits(den)) {
+        auto n = integer_type(num), d = integer_type(den);
+        if (d != 1) {
+            auto ux = n < 0 ? 0 - uint64_t(n) : uint64_t(n);
+            auto gcd = integer_type(binary_gcd(ux, uint64_t(d)));
+            n /= gcd;
+            d /= gcd;
+        }
+        num_ = n;
+        den_ = d;
+        return;
+    }
+    auto ux = num < 0 ? 0 - unsigned_wide(num) : unsigned_wide(num);
+    auto gcd = wide_type(binary_gcd(ux, unsigned_wide(den)));
+    num /= gcd;
+    den /= gcd;
+    if ((! fits(num) || ! fits(den)) && checked())
+        overflow();
+    num_ = integer_type(num);
+    den_ = integer_type(den);
+}
+
+constexpr void Rational::add_fraction(const Rational& rhs, integer_type sign) {
+    auto gcd = integer_type(binary_gcd(uint64_t(den_), uint64_t(rhs.den_)));
+    assign(wide_type(num_) * (rhs.den_ / gcd) + sign * wide_type(rhs.num_) * (den_ / gcd),
+        wide_type(den_ / gcd) * rhs.den_);
+}
+
+constexpr void Rational::multiply_fraction(const Rational& rhs) {
+    assign(wide_type(num_) * rhs.num_, wide_type(den_) * rhs.den_);
+}
+
+template <typename T>
+constexpr int Rational::count_trailing_zeros(T x) noexcept {
+    if constexpr (sizeof(T) <= sizeof(unsigned long long)) {
+        return __builtin_ctzll(x);
+    } else {
+        auto low = static_cast<unsigned long long>(x);
+        return low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll(static_cast<unsigned long long>(x >> 64));
+    }
+}
+
+// Binary (Stein) gcd: only shifts and subtractions, no division
+
+template <typename T>
+constexpr T Rational::binary_gcd(T x, T y) noexcept {
+    if (x == 0)
+        return y;
+    if (y == 0)
+        return x;
+    auto shift = count_trailing_zeros(x | y);
+    x >>= count_trailing_zeros(x);
+    do {
+        y >>= count_trailing_zeros(y);
+        if (x > y) {
+            auto t = x;
+            x = y;
+            y = t;
+        }
+        y -= x;
+    } while (y != 0);
+    return x << shift;
+}
+
+constexpr Rational operator+(const Rational& lhs, const Rational& rhs) { auto r = lhs; r += rhs; return r; }
+constexpr Rational operator-(const Rational& lhs, const Rational& rhs) { auto r = lhs; r -= rhs; return r; }
+constexpr Rational operator*(const Rational& lhs, const Rational& rhs) { auto r = lhs; r *= rhs; return r; }
+constexpr Rational operator/(const Rational& lhs, const Rational& rhs) { auto r = lhs; r /= rhs; return r; }
+constexpr bool operator==(const Rational& lhs, const Rational& rhs) noexcept { return lhs.num() == rhs.num() && lhs.den() == rhs.den(); }
+constexpr bool operator!=(const Rational& lhs, const Rational& rhs) noexcept { return ! (lhs == rhs); }
+constexpr bool operator<(const Rational& lhs, const Rational& rhs) noexcept {
+    __extension__ using wide_type = __int128;
+    if (lhs.den() == rhs.den())
+        return lhs.num() < rhs.num();
+    return wide_type(lhs.num()) * rhs.den() < wide_type(rhs.num()) * lhs.den();
+}
+constexpr bool operator>(const Rational& lhs, const Rational& rhs) noexcept { return rhs < lhs; }
+constexpr bool operator<=(const Rational& lhs, const Rational& rhs) noexcept { return ! (rhs < lhs); }
+constexpr bool operator>=(const Rational& lhs, const Rational& rhs) noexcept { return ! (lhs < rhs); }
 inline std::ostream& operator<<(std::ostream& out, const Rational& r) { return out << r.str(); }
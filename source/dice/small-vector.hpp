@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename T, std::size_t N>
+class SmallVector {
+public:
+    static_assert(N > 0);
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+    static constexpr std::size_t inline_capacity = N;
+    SmallVector() noexcept {}
+    SmallVector(const SmallVector& v);
+    SmallVector(SmallVector&& v) noexcept(std::is_nothrow_move_constructible_v<T>);
+    ~SmallVector() noexcept;
+    SmallVector& operator=(const SmallVector& v);
+    SmallVector& operator=(SmallVector&& v) noexcept(std::is_nothrow_move_constructible_v<T>);
+    T& operator[](std::size_t i) noexcept { return data_[i]; }
+    const T& operator[](std::size_t i) const noexcept { return data_[i]; }
+    T* begin() noexcept { return data_; }
+    const T* begin() const noexcept { return data_; }
+    T* end() noexcept { return data_ + size_; }
+    const T* end() const noexcept { return data_ + size_; }
+    T* data() noexcept { return data_; }
+    const T* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    std::size_t capacity() const noexcept { return capacity_; }
+    bool empty() const noexcept { return size_ == 0; }
+    bool is_inline() const noexcept { return data_ == local(); }
+    void clear() noexcept;
+    void reserve(std::size_t n);
+    template <typename... Args> T* emplace(const T* pos, Args&&... args);
+    T* insert(const T* pos, const T& t) { return emplace(pos, t); }
+    T* insert(const T* pos, T&& t) { return emplace(pos, std::move(t)); }
+    void push_back(const T& t) { emplace(end(), t); }
+    void push_back(T&& t) { emplace(end(), std::move(t)); }
+    T* erase(const T* pos) noexcept;
+private:
+    alignas(T) unsigned char local_[N * sizeof(T)];
+    T* data_ = local();
+    std::size_t size_ = 0;
+    std::size_t capacity_ = N;
+    T* local() noexcept { return reinterpret_cast<T*>(local_); }
+    const T* local() const noexcept { return reinterpret_cast<const T*>(local_); }
+    void release() noexcept;
+    void take(SmallVector&& v) noexcept(std::is_nothrow_move_constructible_v<T>);
+    static void relocate(T* src, std::size_t n, T* dst);
+};
+
+template <typename T, std::size_t N>
+SmallVector<T, N>::SmallVector(const SmallVector& v) {
+    reserve(v.size_);
+    std::uninitialized_copy(v.begin(), v.end(), data_);
+    size_ = v.size_;
+}
+
+template <typename T, std::size_t N>
+SmallVector<T, N>::SmallVector(SmallVector&& v) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    take(std::move(v));
+}
+
+template <typename T, std::size_t N>
+SmallVector<T, N>::~SmallVector() noexcept {
+    release();
+}
+
+template <typename T, std::size_t N>
+SmallVector<T, N>& SmallVector<T, N>::operator=(const SmallVector& v) {
+    if (&v != this) {
+        SmallVector t(v);
+        *this = std::move(t);
+    }
+    return *this;
+}
+
+template <typename T, std::size_t N>
+SmallVector<T, N>& SmallVector<T, N>::operator=(SmallVector&& v) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    if (&v != this) {
+        release();
+        take(std::move(v));
+    }
+    return *this;
+}
+
+template <typename T, std::size_t N>
+void SmallVector<T, N>::clear() noexcept {
+    std::destroy(begin(), end());
+    size_ = 0;
+}
+
+template <typename T, std::size_t N>
+void SmallVector<T, N>::reserve(std::size_t n) {
+    if (n <= capacity_)
+        return;
+    n = std::max(n, 2 * capacity_);
+    auto ptr = std::allocator<T>().allocate(n);
+    try {
+        relocate(data_, size_, ptr);
+    }
+    catch (...) {
+        std::allocator<T>().deallocate(ptr, n);
+        throw;
+    }
+    std::destroy(begin(), end());
+    if (! is_inline())
+        std::allocator<T>().deallocate(data_, capacity_);
+    data_ = ptr;
+    capacity_ = n;
+}
+
+// The new element is constructed before anything is moved, so it can be a
+// copy of an element already in the vector
+
+template <typename T, std::size_t N>
+template <typename... Args>
+T* SmallVector<T, N>::emplace(const T* pos, Args&&... args) {
+    auto i = std::size_t(pos - data_);
+    T t(std::forward<Args>(args)...);
+    reserve(size_ + 1);
+    auto p = data_ + i;
+    if (i == size_) {
+        new (p) T(std::move(t));
+    } else {
+        new (end()) T(std::move(data_[size_ - 1]));
+        std::move_backward(p, end() - 1, end());
+        *p = std::move(t);
+    }
+    ++size_;
+    return p;
+}
+
+template <typename T, std::size_t N>
+T* SmallVector<T, N>::erase(const T* pos) noexcept {
+    auto p = data_ + (pos - data_);
+    std::move(p + 1, end(), p);
+    --size_;
+    std::destroy_at(end());
+    return p;
+}
+
+template <typename T, std::size_t N>
+void SmallVector<T, N>::release() noexcept {
+    clear();
+    if (! is_inline())
+        std::allocator<T>().deallocate(data_, capacity_);
+    data_ = local();
+    capacity_ = N;
+}
+
+// A heap buffer is taken over directly; inline elements have to be moved
+// one at a time. This vector must be empty and inline.
+
+template <typename T, std::size_t N>
+void SmallVector<T, N>::take(SmallVector&& v) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    if (v.is_inline()) {
+        std::uninitialized_move(v.begin(), v.end(), data_);
+        size_ = v.size_;
+        v.clear();
+    } else {
+        data_ = v.data_;
+        size_ = v.size_;
+        capacity_ = v.capacity_;
+        v.data_ = v.local();
+        v.size_ = 0;
+        v.capacity_ = N;
+    }
+}
+
+// Elements are moved only if that cannot throw, so a failed reallocation
+// leaves the original elements intact
+
+template <typename T, std::size_t N>
+void SmallVector<T, N>::relocate(T* src, std::size_t n, T* dst) {
+    if constexpr (std::is_nothrow_move_constructible_v<T>)
+        std::uninitialized_move(src, src + n, dst);
+    else
+        std::uninitialized_copy(src, src + n, dst);
+}
@@ -0,0 +1,109 @@
+#include "dice/statistics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// If every possible result is a multiple of 1/scale, and there are few
+// enough of them, each result gets its own bin and percentiles are exact;
+// otherwise the range is divided into equal bins and percentiles are
+// interpolated
+
+RollStatistics::RollStatistics(const Rational& min, const Rational& max, integer_type scale, std::size_t max_bins):
+exact_(true), low_(real_type(min)) {
+    if (min > max)
+        throw std::invalid_argument("Invalid statistics range");
+    if (max_bins == 0)
+        throw std::invalid_argument("Invalid number of bins");
+    auto range = real_type(max) - real_type(min);
+    std::size_t bins = 1;
+    if (min == max) {
+        width_ = 1;
+    } else if (scale > 0 && range * real_type(scale) < real_type(max_bins)) {
+        auto steps = (max - min) * scale;
+        if (steps.den() != 1)
+            throw std::invalid_argument("Statistics range is not a multiple of the scale");
+        bins = std::size_t(steps.num()) + 1;
+        width_ = 1 / real_type(scale);
+    } else {
+        exact_ = false;
+        bins = max_bins;
+        width_ = range / real_type(bins);
+    }
+    inverse_width_ = 1 / width_;
+    counts_.resize(bins, 0);
+}
+
+// Welford's algorithm
+
+void RollStatistics::add(const Rational& x) {
+    ++count_;
+    if (count_ == 1) {
+        min_ = max_ = x;
+    } else if (x < min_) {
+        min_ = x;
+    } else if (max_ < x) {
+        max_ = x;
+    }
+    auto y = real_type(x);
+    auto delta = y - mean_;
+    mean_ += delta / real_type(count_);
+    m2_ += delta * (y - mean_);
+    if (! counts_.empty()) {
+        auto pos = (y - low_) * inverse_width_;
+        if (exact_)
+            pos = std::round(pos);
+        auto i = pos <= 0 ? std::size_t(0) : std::min(std::size_t(pos), counts_.size() - 1);
+        ++counts_[i];
+    }
+}
+
+// Chan's parallel algorithm
+
+void RollStatistics::merge(const RollStatistics& stats) {
+    if (stats.count_ == 0)
+        return;
+    if (count_ == 0) {
+        *this = stats;
+        return;
+    }
+    if (stats.counts_.size() != counts_.size() || stats.low_ != low_ || stats.width_ != width_)
+        throw std::invalid_argument("Statistics histograms do not match");
+    min_ = std::min(min_, stats.min_);
+    max_ = std::max(max_, stats.max_);
+    auto n1 = real_type(count_), n2 = real_type(stats.count_), n = n1 + n2;
+    auto delta = stats.mean_ - mean_;
+    mean_ += delta * n2 / n;
+    m2_ += stats.m2_ + delta * delta * n1 * n2 / n;
+    count_ += stats.count_;
+    for (std::size_t i = 0; i < counts_.size(); ++i)
+        counts_[i] += stats.counts_[i];
+}
+
+RollStatistics::real_type RollStatistics::sd() const noexcept {
+    return std::sqrt(variance());
+}
+
+// Returns the smallest result (exact) or interpolated value (binned) with
+// at least p% of the results at or below it
+
+RollStatistics::real_type RollStatistics::percentile(real_type p) const {
+    if (! (p >= 0 && p <= 100))
+        throw std::invalid_argument("Invalid percentile");
+    if (count_ == 0 || counts_.empty())
+        throw std::length_error("No histogram data");
+    auto target = p / 100 * real_type(count_);
+    count_type sum = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+        if (counts_[i] == 0)
+            continue;
+        auto next = sum + counts_[i];
+        if (real_type(next) >= target) {
+            if (exact_)
+                return bin_value(i);
+            auto fraction = std::max(target - real_type(sum), 0.0) / real_type(counts_[i]);
+            return std::clamp(bin_value(i) + fraction * width_, real_type(min_), real_type(max_));
+        }
+        sum = next;
+    }
+    return real_type(max_);
+}
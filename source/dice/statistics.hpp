@@ -0,0 +1,44 @@
+#pragma once
+
+#include "dice/dice.hpp"
+#include "dice/rational.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class RollStatistics {
+public:
+    using count_type = uint64_t;
+    using integer_type = int64_t;
+    using real_type = double;
+    static constexpr std::size_t default_bins = 1000;
+    RollStatistics() = default;
+    explicit RollStatistics(const Dice& dice, std::size_t max_bins = default_bins):
+        RollStatistics(dice.min(), dice.max(), dice.scale(), max_bins) {}
+    RollStatistics(const Rational& min, const Rational& max, integer_type scale = 0, std::size_t max_bins = default_bins);
+    void add(const Rational& x);
+    void merge(const RollStatistics& stats);
+    count_type count() const noexcept { return count_; }
+    Rational min() const noexcept { return min_; }
+    Rational max() const noexcept { return max_; }
+    real_type mean() const noexcept { return mean_; }
+    real_type variance() const noexcept { return count_ < 2 ? 0 : m2_ / real_type(count_ - 1); }
+    real_type sd() const noexcept;
+    std::size_t bins() const noexcept { return counts_.size(); }
+    bool is_exact() const noexcept { return exact_; }
+    real_type bin_value(std::size_t i) const noexcept { return low_ + real_type(i) * width_; }
+    real_type bin_width() const noexcept { return width_; }
+    count_type bin_count(std::size_t i) const noexcept { return i < counts_.size() ? counts_[i] : 0; }
+    real_type percentile(real_type p) const;
+private:
+    count_type count_ = 0;
+    Rational min_;
+    Rational max_;
+    real_type mean_ = 0;
+    real_type m2_ = 0; // Sum of squared deviations from the mean
+    bool exact_ = false;
+    real_type low_ = 0;
+    real_type width_ = 0;
+    real_type inverse_width_ = 0;
+    std::vector<count_type> counts_;
+};
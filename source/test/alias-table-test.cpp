@@ -0,0 +1,41 @@
+#include "dice/alias-table.hpp"
+#include "unit-test.hpp"
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+void test_alias_table_sampling() {
+
+    static constexpr int iterations = 100'000;
+
+    AliasTable table;
+    std::minstd_rand rng(42);
+    std::vector<int> counts;
+    std::vector<double> weights;
+
+    TEST_EQUAL(table.size(), 1u);
+    for (int i = 0; i < 100; ++i)
+        TEST_EQUAL(table(rng), 0u);
+
+    weights = {1, 0, 2, 3, 0, 4};
+    TRY(table = AliasTable(weights));
+    TEST_EQUAL(table.size(), 6u);
+    counts.assign(6, 0);
+    for (int i = 0; i < iterations; ++i) {
+        std::size_t j = 0;
+        TRY(j = table(rng));
+        REQUIRE(j < 6);
+        ++counts[j];
+    }
+    TEST_EQUAL(counts[1], 0);
+    TEST_EQUAL(counts[4], 0);
+    TEST_NEAR(counts[0] / double(iterations), 0.1, 0.005);
+    TEST_NEAR(counts[2] / double(iterations), 0.2, 0.007);
+    TEST_NEAR(counts[3] / double(iterations), 0.3, 0.008);
+    TEST_NEAR(counts[5] / double(iterations), 0.4, 0.008);
+
+    TEST_THROW(AliasTable(std::vector<double>{}), std::length_error);
+    TEST_THROW(AliasTable(std::vector<double>{0, 0}), std::invalid_argument);
+    TEST_THROW(AliasTable(std::vector<double>{1, -1}), std::invalid_argument);
+
+}
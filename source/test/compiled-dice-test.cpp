@@ -0,0 +1,64 @@
+#include "dice/compiled-dice.hpp"
+#include "dice/dice.hpp"
+#include "dice/distribution.hpp"
+#include "dice/rational.hpp"
+#include "unit-test.hpp"
+#include <map>
+#include <random>
+
+void test_compiled_dice_construction() {
+
+    CompiledDice cd;
+    std::minstd_rand rng(42);
+
+    TEST_EQUAL(cd.size(), 1u);
+    TEST_EQUAL(cd.min(), 0);
+    TEST_EQUAL(cd.max(), 0);
+    TEST_EQUAL(cd(rng), 0);
+
+    TRY(cd = CompiledDice(Dice("3d6")));
+    TEST_EQUAL(cd.size(), 16u);
+    TEST_EQUAL(cd.min(), 3);
+    TEST_EQUAL(cd.max(), 18);
+
+    TRY(cd = CompiledDice(Dice("d6*2")));
+    TEST_EQUAL(cd.size(), 6u);
+    TEST_EQUAL(cd.min(), 2);
+    TEST_EQUAL(cd.max(), 12);
+
+    TRY(cd = CompiledDice(Dice("3d6+2d10x5/2")));
+    TEST_EQUAL(cd.min(), 8);
+    TEST_EQUAL(cd.max(), 68);
+
+}
+
+void test_compiled_dice_generation() {
+
+    static constexpr int iterations = 100'000;
+
+    Dice dice;
+    CompiledDice cd;
+    Distribution dist;
+    std::minstd_rand rng(42);
+    std::map<Rational, int> counts;
+    Rational x;
+
+    TRY(dice = Dice("3d6+2d10x5/2"));
+    TRY(dist = dice.distribution());
+    TRY(cd = CompiledDice(dist));
+
+    for (int i = 0; i < iterations; ++i) {
+        TRY(x = cd(rng));
+        ++counts[x];
+    }
+
+    TEST(counts.begin()->first >= dice.min());
+    TEST(counts.rbegin()->first <= dice.max());
+
+    for (auto& [value, count]: counts) {
+        auto p = dist.pmf(value);
+        TEST(p > 0);
+        TEST_NEAR(count / double(iterations), p, 0.005);
+    }
+
+}
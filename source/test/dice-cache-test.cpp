@@ -0,0 +1,176 @@
+#include "dice/dice-cache.hpp"
+#include "dice/dice.hpp"
+#include "dice/rational.hpp"
+#include "unit-test.hpp"
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+void test_dice_cache_lookup() {
+
+    DiceCache cache(3);
+    std::shared_ptr<const CachedDice> a, b;
+
+    TEST_EQUAL(cache.capacity(), 3u);
+    TEST_EQUAL(cache.size(), 0u);
+
+    TRY(a = cache.get("3d6+2"));
+    REQUIRE(a);
+    TEST_EQUAL(a->dice().str(), "3d6+2");
+    TEST_EQUAL(cache.size(), 1u);
+    TEST_EQUAL(cache.hits(), 0u);
+    TEST_EQUAL(cache.misses(), 1u);
+
+    TRY(b = cache.get("3d6+2"));
+    TEST(a == b);
+    TEST_EQUAL(cache.hits(), 1u);
+    TEST_EQUAL(cache.misses(), 1u);
+
+    // Different spelling, same canonical form
+    TRY(b = cache.get("2 + 3D6"));
+    TEST(a == b);
+    TEST_EQUAL(cache.size(), 1u);
+    TEST_EQUAL(cache.hits(), 1u);
+    TEST_EQUAL(cache.misses(), 2u);
+    TRY(b = cache.get("2 + 3D6"));
+    TEST(a == b);
+    TEST_EQUAL(cache.hits(), 2u);
+
+    TEST_THROW(cache.get("3d6+"), std::invalid_argument);
+    TEST_EQUAL(cache.size(), 1u);
+
+    TRY(cache.clear());
+    TEST_EQUAL(cache.size(), 0u);
+    TEST_EQUAL(cache.hits(), 0u);
+    TEST_EQUAL(cache.misses(), 0u);
+    TEST_EQUAL(a->dice().str(), "3d6+2");
+
+    TEST_THROW(DiceCache(0), std::invalid_argument);
+
+}
+
+void test_dice_cache_eviction() {
+
+    DiceCache cache(3);
+    std::shared_ptr<const CachedDice> a, b, c;
+
+    TRY(a = cache.get("d4"));
+    TRY(cache.get("d6"));
+    TRY(cache.get("d8"));
+    TRY(cache.get("1d4"));
+    TEST_EQUAL(cache.size(), 3u);
+    TRY(cache.get("d10"));
+    TEST_EQUAL(cache.size(), 3u);
+    TEST_EQUAL(cache.misses(), 5u);
+
+    // d6 was least recently used
+    TRY(cache.get("d4"));
+    TRY(cache.get("d8"));
+    TEST_EQUAL(cache.misses(), 5u);
+    TRY(b = cache.get("d6"));
+    TEST_EQUAL(cache.misses(), 6u);
+
+    // Now d10 has gone, along with its alias
+    TRY(c = cache.get("1d4"));
+    TEST(a == c);
+    TRY(cache.get("d10"));
+    TEST_EQUAL(cache.misses(), 7u);
+
+}
+
+void test_dice_cache_aliases() {
+
+    DiceCache cache(2);
+    std::shared_ptr<const CachedDice> a, b;
+    std::vector<std::string> spellings;
+
+    for (int i = 1; i <= 20; ++i)
+        spellings.push_back("d6+" + std::to_string(i) + "-" + std::to_string(i));
+
+    TRY(a = cache.get("1d6"));
+    for (auto& s: spellings) {
+        TRY(b = cache.get(s));
+        TEST(a == b);
+    }
+    TEST_EQUAL(cache.size(), 1u);
+    TEST_EQUAL(cache.misses(), 21u);
+
+    // Only the most recent spellings are remembered
+
+    for (auto i = spellings.size() - DiceCache::max_aliases; i < spellings.size(); ++i)
+        TRY(cache.get(spellings[i]));
+    TEST_EQUAL(cache.misses(), 21u);
+    TRY(cache.get("d6"));
+    TEST_EQUAL(cache.misses(), 21u);
+    TRY(b = cache.get("1d6"));
+    TEST(a == b);
+    TEST_EQUAL(cache.misses(), 22u);
+    TRY(cache.get(spellings.back()));
+    TEST_EQUAL(cache.misses(), 22u);
+    TRY(cache.get(spellings.front()));
+    TEST_EQUAL(cache.misses(), 23u);
+
+    // Forgotten spellings are dropped from the index with their entry
+
+    TRY(cache.get("d8"));
+    TRY(cache.get("d10"));
+    TEST_EQUAL(cache.size(), 2u);
+    TRY(b = cache.get("1d6"));
+    TEST(a != b);
+    TEST_EQUAL(cache.misses(), 26u);
+
+    // Modified groups are in canonical order, so their spellings share an
+    // entry too
+
+    DiceCache modified;
+    TRY(a = modified.get("d6r1+d6"));
+    TRY(b = modified.get("d6+d6r1"));
+    TEST(a == b);
+    TRY(b = modified.get("4d6kh2+4d6kh3+5d10>=8"));
+    TRY(a = modified.get("5d10>=8+4d6kh3+4d6kh2"));
+    TEST(a == b);
+    TEST_EQUAL(modified.size(), 2u);
+
+}
+
+void test_dice_cache_tables() {
+
+    DiceCache cache;
+    std::shared_ptr<const CachedDice> a;
+
+    TRY(a = cache.get("2d6"));
+    TEST_EQUAL(a->distribution().size(), 11u);
+    TEST_NEAR(a->distribution().probability(5), 1.0 / 6, 1e-12);
+    TEST_EQUAL(a->compiled().size(), 11u);
+    TEST_EQUAL(a->compiled().min(), 2);
+    TEST_EQUAL(a->compiled().max(), 12);
+    TEST(&a->compiled() == &cache.get("2d6")->compiled());
+
+}
+
+void test_dice_cache_threads() {
+
+    static constexpr std::size_t n_threads = 8;
+    static constexpr std::size_t n_lookups = 1000;
+
+    DiceCache cache(4);
+    std::vector<std::thread> threads;
+    const char* patterns[] = {"d4", "d6", "d8", "d10", "d12", "d20"};
+
+    for (std::size_t i = 0; i < n_threads; ++i)
+        threads.emplace_back([&cache,&patterns,i] {
+            for (std::size_t j = 0; j < n_lookups; ++j) {
+                auto p = cache.get(patterns[(i + j) % 6]);
+                p->compiled();
+            }
+        });
+    for (auto& t: threads)
+        t.join();
+
+    TEST_EQUAL(cache.size(), 4u);
+    TEST_EQUAL(cache.hits() + cache.misses(), n_threads * n_lookups);
+
+}
@@ -1,11 +1,17 @@
 #include "dice/dice.hpp"
+#include "dice/distribution.hpp"
 #include "dice/rational.hpp"
 #include "unit-test.hpp"
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <functional>
+#include <limits>
 #include <random>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -34,6 +40,35 @@ namespace {
         int num_ = 0;
     };
 
+    // Counts of each sum of the highest or lowest k of n dice, by
+    // enumerating every roll, skipping rolls with a rerolled face
+
+    std::vector<int> brute_force_keep(int n, int faces, int k, bool high, int reroll = 0) {
+        std::vector<int> counts(k * faces + 1, 0);
+        std::vector<int> roll(n, 1);
+        for (;;) {
+            auto sorted = roll;
+            if (std::find(roll.begin(), roll.end(), reroll) != roll.end())
+                sorted.assign(n, 0);
+            if (high)
+                std::sort(sorted.begin(), sorted.end(), std::greater<int>());
+            else
+                std::sort(sorted.begin(), sorted.end());
+            int sum = 0;
+            for (int i = 0; i < k; ++i)
+                sum += sorted[i];
+            if (sum > 0)
+                ++counts[sum];
+            int i = 0;
+            while (i < n && roll[i] == faces)
+                roll[i++] = 1;
+            if (i == n)
+                break;
+            ++roll[i];
+        }
+        return counts;
+    }
+
 }
 
 void test_dice_arithmetic() {
@@ -54,6 +89,78 @@ void test_dice_arithmetic() {
 
     TEST_THROW(c = a / 0, std::invalid_argument);
 
+    TRY(c = a);
+    TRY(c += b);     TEST_EQUAL(c.str(), "3d10+2d6");
+    TRY(c += c);     TEST_EQUAL(c.str(), "6d10+4d6");
+    TRY(c -= c);     TEST_EQUAL(c.str(), "-6d10+6d10-4d6+4d6");
+    TRY(c = Dice("d4+d6+d8+d10+d12") + Dice("d20+2d6+d100") - 5);
+    TEST_EQUAL(c.str(), "d100+d20+d12+d10+d8+3d6+d4-5");
+    TRY(c = Dice("4d6kh3+2d6") + Dice("4d6kh3+d6!+d6"));
+    TEST_EQUAL(c.str(), "3d6+d6!+4d6kh3+4d6kh3");
+    TRY(c = Dice("4d6kh3+d8+2"));
+    TRY(c -= c);
+    TEST_EQUAL(c.str(), "-d8+d8-4d6kh3+4d6kh3");
+    TEST_EQUAL(c.mean(), 0);
+
+    // Subtraction reverses the order of groups with the same faces
+
+    TRY(c = Dice() - Dice("d6+d6*2"));
+    TEST_EQUAL(c.str(), "-d6*2-d6");
+    TRY(c += Dice("-d6*2"));
+    TEST_EQUAL(c.str(), "-2d6*2-d6");
+    TEST_EQUAL(c.mean(), Rational(-35, 2));
+    TRY(c = Dice("-d6*3/2") - Dice("d6+d6*2"));
+    TEST_EQUAL(c.str(), "-d6*2-d6*3/2-d6");
+    TRY(c -= Dice("d6*3/2"));
+    TEST_EQUAL(c.str(), "-d6*2-2d6*3/2-d6");
+    TEST_EQUAL(c.mean(), -21);
+
+    // Groups from dice with different sampling modes are prepared again
+
+    TRY(a.set_sampling(Dice::sampling_mode::table));
+    TRY(c = a + Dice("3d6+d8"));
+    TEST_EQUAL(c.str(), "d8+5d6");
+    TEST(c.sampling() == Dice::sampling_mode::table);
+    TEST_EQUAL(c.distribution().size(), 33u);
+    TRY(c = a - Dice("d6+d6*2+d8") + Dice("-d6*2"));
+    TEST_EQUAL(c.str(), "-d8-2d6*2-d6+2d6");
+    TEST(c.sampling() == Dice::sampling_mode::table);
+    TEST_EQUAL(c.mean(), -15);
+    TRY(c = Dice("d6+d6*2") - Dice("2d6kh1*2+2d6kl1*2+d6*3"));
+    TEST_EQUAL(c.str(), "-d6*3-2d6kh1*2-2d6kl1*2+d6+d6*2");
+    TRY(c = Dice("d6+d6*2"));
+    TRY(c -= c);
+    TEST_EQUAL(c.str(), "-d6*2-d6+d6+d6*2");
+    TRY(c += Dice("-d6*2") - Dice("d6"));
+    TEST_EQUAL(c.str(), "-2d6*2-2d6+d6+d6*2");
+    TEST_EQUAL(c.mean(), Rational(-21, 2));
+
+    // Copies share the state of modified groups until one is changed
+
+    TRY(a = Dice("10d10>=8"));
+    TRY(c = a);
+    TRY(c += Dice("90d10>=8"));
+    TEST_EQUAL(a.str(), "10d10>=8");
+    TEST_EQUAL(c.str(), "100d10>=8");
+    std::minstd_rand rng(42);
+    Rational x, a_max, c_max;
+    for (int i = 0; i < 1000; ++i) {
+        TRY(x = a(rng));
+        a_max = std::max(a_max, x);
+        TRY(x = c(rng));
+        c_max = std::max(c_max, x);
+    }
+    TEST(a_max <= 10);
+    TEST(c_max > 10);
+
+    // A failed merge leaves the dice unchanged
+
+    TRY(c = Dice("2d6+d1000000+1"));
+    TRY(c.set_sampling(Dice::sampling_mode::table));
+    TEST_THROW(c += Dice("3d8+20d1000000"), std::length_error);
+    TEST_EQUAL(c.str(), "d1000000+2d6+1");
+    TEST_EQUAL(c.mean(), Rational(1'000'017, 2));
+
 }
 
 void test_dice_statistics() {
@@ -144,6 +251,29 @@ void test_dice_parser() {
 
 }
 
+void test_dice_parser_errors() {
+
+    Dice dice;
+
+    TRY(dice = Dice("3dx2"));              TEST_EQUAL(dice.str(), "3d6*2");
+    TRY(dice = Dice("2xd"));               TEST_EQUAL(dice.str(), "d6*2");
+    TRY(dice = Dice("1 0 D 2 0 X 3"));     TEST_EQUAL(dice.str(), "10d20*3");
+    TRY(dice = Dice("-d6/0 2"));           TEST_EQUAL(dice.str(), "-d6/2");
+    TRY(dice = Dice("0d6+d0+5x0d6"));      TEST_EQUAL(dice.str(), "0");
+
+    TEST_THROW_MESSAGE(Dice("+"), std::invalid_argument, "Invalid dice at end: \"+\"");
+    TEST_THROW_MESSAGE(Dice("3d6+"), std::invalid_argument, "Invalid dice at end: \"3d6+\"");
+    TEST_THROW_MESSAGE(Dice("3d6+x"), std::invalid_argument, "Invalid dice at offset 4: \"3d6+x\"");
+    TEST_THROW_MESSAGE(Dice("3d6 x"), std::invalid_argument, "Invalid dice at offset 4: \"3d6 x\"");
+    TEST_THROW_MESSAGE(Dice("3x2"), std::invalid_argument, "Invalid dice at offset 1: \"3x2\"");
+    TEST_THROW_MESSAGE(Dice("2d6/"), std::invalid_argument, "Invalid dice at offset 3: \"2d6/\"");
+    TEST_THROW_MESSAGE(Dice("2d6*"), std::invalid_argument, "Invalid dice at offset 3: \"2d6*\"");
+    TEST_THROW_MESSAGE(Dice("+-3"), std::invalid_argument, "Invalid dice at offset 1: \"+-3\"");
+    TEST_THROW_MESSAGE(Dice("d6 + 2e"), std::invalid_argument, "Invalid dice at offset 6: \"d6 + 2e\"");
+    TEST_THROW_MESSAGE(Dice("2d6/0"), std::invalid_argument, "Division by zero");
+
+}
+
 void test_dice_generation() {
 
     static constexpr int iterations = 1'000'000;
@@ -162,7 +292,7 @@ void test_dice_generation() {
     }
     TEST_EQUAL(stats.min(), double(dice.min()));
     TEST_EQUAL(stats.max(), double(dice.max()));
-    TEST_NEAR(stats.mean(), double(dice.mean()), tolerance);
+    TEST_NEAR(stats.mean(), double(dice.mean()), 4 * dice.sd() / std::sqrt(double(iterations)));
     TEST_NEAR(stats.sd(), dice.sd(), tolerance);
 
     stats = {};
@@ -173,7 +303,7 @@ void test_dice_generation() {
     }
     TEST_EQUAL(stats.min(), double(dice.min()));
     TEST_EQUAL(stats.max(), double(dice.max()));
-    TEST_NEAR(stats.mean(), double(dice.mean()), tolerance);
+    TEST_NEAR(stats.mean(), double(dice.mean()), 4 * dice.sd() / std::sqrt(double(iterations)));
     TEST_NEAR(stats.sd(), dice.sd(), tolerance);
 
     stats = {};
@@ -184,7 +314,7 @@ void test_dice_generation() {
     }
     TEST_EQUAL(stats.min(), double(dice.min()));
     TEST_EQUAL(stats.max(), double(dice.max()));
-    TEST_NEAR(stats.mean(), double(dice.mean()), tolerance);
+    TEST_NEAR(stats.mean(), double(dice.mean()), 4 * dice.sd() / std::sqrt(double(iterations)));
     TEST_NEAR(stats.sd(), dice.sd(), tolerance);
 
 }
@@ -202,3 +332,731 @@ void test_dice_literals() {
     TRY(dice = 5_d100);  TEST_EQUAL(dice.str(), "5d100");
 
 }
+
+void test_dice_distribution() {
+
+    Dice dice;
+    Distribution dist;
+
+    TRY(dist = dice.distribution());
+    TEST_EQUAL(dist.size(), 1u);
+    TEST_EQUAL(dist.pmf(0), 1);
+
+    TRY(dice = Dice("2d6"));
+    TRY(dist = dice.distribution());
+    TEST_EQUAL(dist.size(), 11u);
+    TEST_EQUAL(dist.min(), dice.min());
+    TEST_EQUAL(dist.max(), dice.max());
+    TEST_NEAR(dist.mean(), double(dice.mean()), 1e-12);
+    TEST_NEAR(dist.sd(), dice.sd(), 1e-12);
+    TEST_NEAR(dist.pmf(2), 1.0 / 36, 1e-12);
+    TEST_NEAR(dist.pmf(7), 6.0 / 36, 1e-12);
+    TEST_NEAR(dist.cdf(7), 21.0 / 36, 1e-12);
+    TEST_EQUAL(dist.quantile(0.5), 7);
+
+    TRY(dice = Dice("2d10-2d6+10"));
+    TRY(dist = dice.distribution());
+    TEST_EQUAL(dist.min(), dice.min());
+    TEST_EQUAL(dist.max(), dice.max());
+    TEST_NEAR(dist.mean(), double(dice.mean()), 1e-12);
+    TEST_NEAR(dist.sd(), dice.sd(), 1e-12);
+    TEST_NEAR(dist.pmf(0), 1.0 / 3600, 1e-12);
+    TEST_NEAR(dist.cdf(13), 1 - dist.cdf(14), 1e-12);
+
+    TRY(dice = Dice("2d10*3+d8*3/4-2d6/4+10"));
+    TRY(dist = dice.distribution());
+    TEST_EQUAL(dist.min(), dice.min());
+    TEST_EQUAL(dist.max(), dice.max());
+    TEST_NEAR(dist.mean(), double(dice.mean()), 1e-9);
+    TEST_NEAR(dist.sd(), dice.sd(), 1e-9);
+    TEST_NEAR(dist.pmf(dice.min()), 1.0 / 28800, 1e-12);
+    TEST_NEAR(dist.pmf(Rational(111, 8)), 0, 1e-12);
+
+}
+
+void test_dice_sampling_modes() {
+
+    static constexpr int iterations = 100'000;
+
+    Dice dice;
+    std::minstd_rand rng(42);
+    Statistics stats;
+    Rational x;
+
+    TEST(dice.sampling() == Dice::sampling_mode::roll);
+    TEST_EQUAL(dice.threshold(), Dice::default_threshold);
+    TEST_THROW(dice.set_sampling(Dice::sampling_mode::normal, 0), std::invalid_argument);
+
+    TRY(dice = Dice("10d6+3d20*2-5"));
+    TRY(dice.set_sampling(Dice::sampling_mode::table));
+    TEST(dice.sampling() == Dice::sampling_mode::table);
+    for (int i = 0; i < iterations; ++i) {
+        TRY(x = dice(rng));
+        TRY(stats.add(double(x)));
+    }
+    TEST(stats.min() >= double(dice.min()));
+    TEST(stats.max() <= double(dice.max()));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.3);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.3);
+
+    TRY(dice += Dice(5, 6));
+    TEST_EQUAL(dice.str(), "3d20*2+15d6-5");
+    stats = {};
+    for (int i = 0; i < iterations; ++i) {
+        TRY(x = dice(rng));
+        TRY(stats.add(double(x)));
+    }
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.3);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.3);
+
+    for (auto mode: {Dice::sampling_mode::normal, Dice::sampling_mode::edgeworth}) {
+        TRY(dice = Dice(1'000'000, 6) + Dice(4, 10));
+        TRY(dice.set_sampling(mode, 100));
+        TEST_EQUAL(dice.threshold(), 100);
+        stats = {};
+        for (int i = 0; i < iterations; ++i) {
+            TRY(x = dice(rng));
+            TRY(stats.add(double(x)));
+        }
+        TEST(stats.min() >= double(dice.min()));
+        TEST(stats.max() <= double(dice.max()));
+        TEST_NEAR(stats.mean(), double(dice.mean()), 25);
+        TEST_NEAR(stats.sd() / dice.sd(), 1, 0.01);
+    }
+
+}
+
+void test_dice_batch_generation() {
+
+    static constexpr std::size_t iterations = 100'000;
+
+    Dice dice;
+    std::minstd_rand rng(42);
+    std::vector<Rational> rationals(iterations);
+    std::vector<double> reals(iterations);
+    std::vector<Dice::integer_type> integers(iterations);
+    Statistics stats;
+
+    TRY(dice = Dice("2d10-2d6+10"));
+    TEST(dice.is_integral());
+
+    TRY(dice.roll_n(rng, rationals.data(), iterations));
+    for (auto& x: rationals)
+        TRY(stats.add(double(x)));
+    TEST_EQUAL(stats.min(), double(dice.min()));
+    TEST_EQUAL(stats.max(), double(dice.max()));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.1);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.1);
+
+    stats = {};
+    TRY(dice.roll_n(rng, reals.data(), iterations));
+    for (auto x: reals)
+        TRY(stats.add(x));
+    TEST_EQUAL(stats.min(), double(dice.min()));
+    TEST_EQUAL(stats.max(), double(dice.max()));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.1);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.1);
+
+    stats = {};
+    TRY(dice.roll_n(rng, integers.data(), iterations));
+    for (auto x: integers)
+        TRY(stats.add(double(x)));
+    TEST_EQUAL(stats.min(), double(dice.min()));
+    TEST_EQUAL(stats.max(), double(dice.max()));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.1);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.1);
+
+    TRY(dice = Dice("2d10*3+d8*3/4-2d6/4+10"));
+    TEST(! dice.is_integral());
+    TEST_THROW(dice.roll_n(rng, integers.data(), iterations), std::invalid_argument);
+    TRY(dice = Dice(10, 6) * 1'000'000'000'000'000'000);
+    TEST(dice.is_integral());
+    TEST_EQUAL(dice.scale(), 0);
+    TEST_THROW(dice.roll_n(rng, integers.data(), iterations), std::overflow_error);
+    TRY(dice.roll_n(rng, reals.data(), iterations));
+
+    TRY(dice = Dice("2d10*3+d8*3/4-2d6/4+10"));
+    stats = {};
+    TRY(dice.roll_n(rng, rationals.data(), iterations));
+    for (auto& x: rationals)
+        TRY(stats.add(double(x)));
+    TEST(stats.min() >= double(dice.min()));
+    TEST(stats.max() <= double(dice.max()));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.3);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.3);
+
+    TRY(dice = Dice(100, 6));
+    TRY(dice.set_sampling(Dice::sampling_mode::table));
+    stats = {};
+    TRY(dice.roll_n(rng, reals.data(), iterations));
+    for (auto x: reals)
+        TRY(stats.add(x));
+    TEST(stats.min() >= double(dice.min()));
+    TEST(stats.max() <= double(dice.max()));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.3);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.3);
+
+    TRY(dice.roll_n(rng, rationals.data(), 0));
+
+}
+
+void test_dice_scaled_generation() {
+
+    static constexpr int iterations = 10'000;
+
+    Dice dice;
+    std::minstd_rand rng1(42), rng2(42);
+    Rational x;
+    Dice::integer_type y = 0;
+
+    TEST_EQUAL(dice.scale(), 1);
+    TEST_EQUAL(dice.roll_scaled(rng1), 0);
+
+    TRY(dice = Dice("2d10-2d6+10"));
+    TEST_EQUAL(dice.scale(), 1);
+
+    TRY(dice = Dice("2d10*3+d8*3/4-2d6/4+10"));
+    TEST_EQUAL(dice.scale(), 4);
+    for (int i = 0; i < iterations; ++i) {
+        TRY(x = dice(rng1));
+        TRY(y = dice.roll_scaled(rng2));
+        TEST_EQUAL(x, Rational(y, 4));
+        REQUIRE(x >= dice.min() && x <= dice.max());
+    }
+
+    TRY(dice = Dice("d6/2+d6/3+d6/5+1/7"));
+    TEST_EQUAL(dice.scale(), 210);
+    TRY(dice += Rational(1, 14));
+    TEST_EQUAL(dice.scale(), 210);
+    TRY(dice *= Rational(1, 11));
+    TEST_EQUAL(dice.scale(), 2310);
+    TRY(y = dice.roll_scaled(rng1));
+    TEST(Rational(y, 2310) >= dice.min());
+    TEST(Rational(y, 2310) <= dice.max());
+
+    TRY(dice = Dice(1, 6) / 5'000'000'000 + Dice(1, 6) / 5'000'000'001);
+    TEST_EQUAL(dice.scale(), 0);
+    TEST_THROW(dice.roll_scaled(rng1), std::overflow_error);
+
+    // The bound on scaled results is checked without overflow at the edge
+    // of the integer range
+
+    static constexpr auto max_integer = std::numeric_limits<Dice::integer_type>::max();
+    TRY(dice = Dice(1, 2) * Rational(- max_integer / 2));
+    TEST_EQUAL(dice.scale(), 1);
+    TRY(dice = Dice(1, 2) * Rational(- max_integer / 2 - 1));
+    TEST_EQUAL(dice.scale(), 0);
+    TRY(dice = Dice(1, 2) * Rational(- max_integer));
+    TEST_EQUAL(dice.scale(), 0);
+    TRY(dice = Dice() - Rational(max_integer));
+    TEST_EQUAL(dice.scale(), 1);
+    TRY(dice += Dice(1, 2));
+    TEST_EQUAL(dice.scale(), 0);
+
+}
+
+void test_dice_keep_modifiers() {
+
+    static constexpr int iterations = 100'000;
+
+    Dice dice;
+    std::mt19937 rng(42);
+    Statistics stats;
+    Distribution dist;
+    std::vector<int> counts;
+
+    TRY(dice = Dice("4d6kh3"));
+    TEST_EQUAL(dice.str(), "4d6kh3");
+    TEST_EQUAL(dice.min(), 3);
+    TEST_EQUAL(dice.max(), 18);
+    TEST_EQUAL(dice.mean(), Rational(15869, 1296));
+    TEST_NEAR(dice.sd(), 2.846844, 1e-6);
+    TRY(dice = Dice("4d6dl1"));
+    TEST_EQUAL(dice.str(), "4d6kh3");
+    TRY(dice = Dice("4D6K3"));
+    TEST_EQUAL(dice.str(), "4d6kh3");
+    TRY(dice = Dice("2d20kl1"));
+    TEST_EQUAL(dice.str(), "2d20kl1");
+    TEST_EQUAL(dice.mean(), Rational(287, 40));
+    TRY(dice = Dice("2d20dh1"));
+    TEST_EQUAL(dice.str(), "2d20kl1");
+    TRY(dice = Dice("2d20kh1"));
+    TEST_EQUAL(dice.mean(), Rational(553, 40));
+
+    TRY(dice = Dice("3d6kh3"));
+    TEST_EQUAL(dice.str(), "3d6");
+    TRY(dice = Dice("3d6kh0+1"));
+    TEST_EQUAL(dice.str(), "1");
+    TRY(dice = Dice("3d1kl2"));
+    TEST_EQUAL(dice.str(), "2d1");
+    TRY(dice = Dice("4d6kh3+4d6kh3+2d6+d6"));
+    TEST_EQUAL(dice.str(), "3d6+4d6kh3+4d6kh3");
+    TEST_EQUAL(dice.mean(), Rational(15869, 648) + Rational(21, 2));
+    TRY(dice = Dice("4d6kh3x2/3-2d8kl1"));
+    TEST_EQUAL(dice.str(), "-2d8kl1+4d6kh3*2/3");
+    TEST_EQUAL(dice.min(), -6);
+    TEST_EQUAL(dice.max(), 11);
+
+    TEST_THROW(Dice("4d6kh5"), std::invalid_argument);
+    TEST_THROW(Dice("4d6k"), std::invalid_argument);
+    TEST_THROW(Dice("4d6dx"), std::invalid_argument);
+    TEST_THROW(Dice("4d6d"), std::invalid_argument);
+
+    for (int n = 1; n <= 4; ++n) {
+        for (int faces: {2, 3, 6}) {
+            for (int k = 1; k <= n; ++k) {
+                for (bool high: {true, false}) {
+                    int total = 1;
+                    for (int i = 0; i < n; ++i)
+                        total *= faces;
+                    TRY(counts = brute_force_keep(n, faces, k, high));
+                    TRY(dice = Dice(std::to_string(n) + "d" + std::to_string(faces) + (high ? "kh" : "kl") + std::to_string(k)));
+                    TRY(dist = dice.distribution());
+                    Rational mean, square;
+                    for (int x = k; x <= k * faces; ++x) {
+                        TEST_NEAR(dist.pmf(x), double(counts[x]) / total, 1e-12);
+                        mean += Rational(x * counts[x], total);
+                        square += Rational(x * x * counts[x], total);
+                    }
+                    TEST_EQUAL(dice.mean(), mean);
+                    TEST_EQUAL(dice.variance(), square - mean * mean);
+                }
+            }
+        }
+    }
+
+    TRY(dice = Dice("4d6kh3"));
+    for (int i = 0; i < iterations; ++i) {
+        Rational x;
+        TRY(x = dice(rng));
+        stats.add(double(x));
+    }
+    TEST_EQUAL(stats.min(), 3);
+    TEST_EQUAL(stats.max(), 18);
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.05);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.05);
+
+    stats = {};
+    TRY(dice = Dice("10d100kl3"));
+    for (int i = 0; i < iterations; ++i) {
+        Rational x;
+        TRY(x = dice(rng));
+        stats.add(double(x));
+    }
+    TEST(stats.min() >= 3);
+    TEST(stats.max() <= 300);
+    TEST_EQUAL(dice.mean(), Rational(5'605'378'787'908'782'879, 100'000'000'000'000'000));
+    TEST_THROW(dice.variance(), std::overflow_error);
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.5);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.5);
+
+    stats = {};
+    TRY(dice.set_sampling(Dice::sampling_mode::table));
+    std::vector<Rational> out(iterations);
+    TRY(dice.roll_n(rng, out.data(), out.size()));
+    for (auto& x: out)
+        stats.add(double(x));
+    TEST_NEAR(stats.mean(), double(dice.mean()), 0.5);
+    TEST_NEAR(stats.sd(), dice.sd(), 0.5);
+
+    TRY(dice = Dice("100d6kh3"));
+    TRY(dist = dice.distribution());
+    TEST_THROW(dice.mean(), std::overflow_error);
+    TEST_NEAR(dice.approx_mean(), dist.mean(), 1e-9);
+    TEST_NEAR(dice.sd(), dist.sd(), 1e-9);
+    TEST(dice.approx_mean() > 17 && dice.approx_mean() < 18);
+
+    // Exact whenever the result fits in a Rational
+
+    for (auto str: {"12d6kh5", "12d6kl5", "10d10r1r10kh4", "10d10r1r10kl4", "13d6r6kh10"}) {
+        TRY(dice = Dice(str));
+        TRY(dist = dice.distribution());
+        Rational mean, variance;
+        TRY(mean = dice.mean());
+        TRY(variance = dice.variance());
+        TEST_NEAR(double(mean), dist.mean(), 1e-9);
+        TEST_NEAR(double(variance), dist.variance(), 1e-9);
+        TEST_EQUAL(dice.approx_mean(), double(mean));
+        TEST_EQUAL(dice.approx_variance(), double(variance));
+    }
+    TRY(dice = Dice("12d6kh5"));
+    TEST_EQUAL(dice.mean(), Rational(9'218'785'135, 362'797'056));
+    TEST_EQUAL(dice.variance(), Rational(952'284'208'099'304'927, 131'621'703'842'267'136));
+    TEST_EQUAL(Dice("12d6kh5").mean() + Dice("12d6kl5").mean(), 35);
+
+    for (auto str: {"20d6kh10", "20d6kl10", "16d10r1r10kh5", "16d10r1r10kl5", "5d1000kh2"}) {
+        TRY(dice = Dice(str));
+        TRY(dist = dice.distribution());
+        Rational mean;
+        TRY(mean = dice.mean());
+        TEST_NEAR(double(mean), dist.mean(), 1e-9);
+        TEST_THROW(dice.variance(), std::overflow_error);
+        TEST_NEAR(dice.approx_variance(), dist.variance(), 1e-6);
+    }
+
+    for (auto str: {"30d10kh10", "30d10kl10", "30d10r1r10kh10", "30d10r1r10kl10", "20d6!!kh5"}) {
+        TRY(dice = Dice(str));
+        TRY(dist = dice.distribution());
+        TEST_NEAR(dice.approx_mean(), dist.mean(), 1e-9);
+        TEST_NEAR(dice.sd(), dist.sd(), 1e-9);
+    }
+    TRY(dice = Dice("20d6!!kh5"));
+    TEST_NEAR(double(dice.mean()), dice.approx_mean(), 1e-9);
+    TRY(dice = Dice("1000d6r1r2r3r4r5kh3"));
+    TEST_EQUAL(dice.mean(), 18);
+    TEST_EQUAL(dice.variance(), 0);
+
+    // Groups that differ only in their modifiers have a canonical order
+
+    Dice a, b;
+    TRY(a = Dice("4d6kh3+4d6kh2"));
+    TRY(b = Dice("4d6kh2+4d6kh3"));
+    TEST_EQUAL(a.str(), "4d6kh2+4d6kh3");
+    TEST_EQUAL(b.str(), "4d6kh2+4d6kh3");
+    TEST(a == b);
+    TRY(a = Dice("4d6kl3+4d6kh3+4d6"));
+    TRY(b = Dice("4d6+4d6kh3") + Dice("4d6kl3"));
+    TEST_EQUAL(a.str(), "4d6+4d6kh3+4d6kl3");
+    TEST_EQUAL(b.str(), "4d6+4d6kh3+4d6kl3");
+    TEST(a == b);
+    TRY(a = Dice("4d6kh3-4d6kh2"));
+    TRY(b = - Dice("4d6kh2") + Dice("4d6kh3"));
+    TEST_EQUAL(a.str(), b.str());
+    TEST(a == b);
+    TEST(a != Dice("4d6kh3-4d6kh1"));
+    TEST(a != Dice("4d6kh3-4d6kh2+1"));
+
+    Dice high, low;
+    TRY(high = Dice("1000d6kh500"));
+    TRY(low = Dice("1000d6kl500"));
+    TEST_THROW(high.mean(), std::overflow_error);
+    TEST_NEAR(high.approx_mean() + low.approx_mean(), 3500, 1e-6);
+    TEST_NEAR(high.sd(), low.sd(), 1e-6);
+    stats = {};
+    for (int i = 0; i < 1000; ++i) {
+        Rational x;
+        TRY(x = high(rng));
+        stats.add(double(x));
+    }
+    TEST_NEAR(stats.mean(), high.approx_mean(), 5);
+    TEST_NEAR(stats.sd(), high.sd(), 5);
+
+}
+
+void test_dice_explode_reroll() {
+
+    static constexpr int iterations = 100'000;
+
+    Dice dice;
+    std::mt19937 rng(42);
+    Statistics stats;
+    Distribution dist;
+    std::vector<int> counts;
+
+    TRY(dice = Dice("d6!"));
+    TEST_EQUAL(dice.str(), "d6!");
+    TEST_EQUAL(dice.mean(), Rational(21, 5));
+    TEST_EQUAL(dice.variance(), Rational(266, 25));
+    TEST_EQUAL(dice.min(), 1);
+    TEST(dice.max() > 100);
+    TRY(dist = dice.distribution());
+    TEST_NEAR(dist.pmf(5), 1.0 / 6, 1e-12);
+    TEST_EQUAL(dist.pmf(6), 0);
+    TEST_NEAR(dist.pmf(7), 1.0 / 36, 1e-12);
+    TEST_NEAR(dist.pmf(13), 1.0 / 216, 1e-12);
+    TEST_NEAR(dist.mean(), 4.2, 1e-9);
+    TEST_NEAR(dist.variance(), 10.64, 1e-6);
+
+    TRY(dice = Dice("3D6!!"));
+    TEST_EQUAL(dice.str(), "3d6!!");
+    TEST_EQUAL(dice.mean(), Rational(63, 5));
+    TRY(dice = Dice("d6r1"));
+    TEST_EQUAL(dice.str(), "d6r1");
+    TEST_EQUAL(dice.mean(), 4);
+    TEST_EQUAL(dice.variance(), 2);
+    TEST_EQUAL(dice.min(), 2);
+    TEST_EQUAL(dice.max(), 6);
+    TRY(dice = Dice("d6r2r1r2"));
+    TEST_EQUAL(dice.str(), "d6r1r2");
+    TRY(dice = Dice("d2!"));
+    TEST_EQUAL(dice.mean(), 3);
+    TEST_EQUAL(dice.variance(), 8);
+    TRY(dice = Dice("2d6!r6"));
+    TEST_EQUAL(dice.str(), "2d6r6");
+    TEST_EQUAL(dice.max(), 10);
+    TRY(dice = Dice("d6!+2d6!+d6!!+d6r1+d6"));
+    TEST_EQUAL(dice.str(), "d6+d6r1+3d6!+d6!!");
+    TRY(dice = Dice("4d6r1kh3"));
+    TEST_EQUAL(dice.str(), "4d6r1kh3");
+    TRY(dice = Dice("4d6kh3r1"));
+    TEST_EQUAL(dice.str(), "4d6r1kh3");
+    TEST_EQUAL(dice.min(), 6);
+    TEST_EQUAL(dice.max(), 18);
+    TRY(dice = Dice("4d6!!kh3"));
+    TEST_EQUAL(dice.str(), "4d6!!kh3");
+
+    TEST_THROW(Dice("d1!"), std::invalid_argument);
+    TEST_THROW(Dice("d6r1r2r3r4r5!"), std::invalid_argument);
+    TEST_THROW(Dice("d6r1r2r3r4r5r6"), std::invalid_argument);
+    TEST_THROW(Dice("d6r7"), std::invalid_argument);
+    TEST_THROW(Dice("d6r"), std::invalid_argument);
+    TEST_THROW(Dice("d6!!!"), std::invalid_argument);
+    TEST_THROW(Dice("4d6!kh3"), std::invalid_argument);
+    TEST_THROW(Dice("4d6kh3kh2"), std::invalid_argument);
+    TEST_THROW(Dice("d20r1r2r3r4r5r6r7r8r9"), std::invalid_argument);
+
+    for (int n = 1; n <= 4; ++n) {
+        for (int k = 1; k <= n; ++k) {
+            for (bool high: {true, false}) {
+                int total = 1;
+                for (int i = 0; i < n; ++i)
+                    total *= 5;
+                TRY(counts = brute_force_keep(n, 6, k, high, 2));
+                TRY(dice = Dice(std::to_string(n) + "d6r2" + (high ? "kh" : "kl") + std::to_string(k)));
+                TRY(dist = dice.distribution());
+                Rational mean, square;
+                for (int x = k; x <= k * 6; ++x) {
+                    TEST_NEAR(dist.pmf(x), double(counts[x]) / total, 1e-12);
+                    mean += Rational(x * counts[x], total);
+                    square += Rational(x * x * counts[x], total);
+                }
+                TEST_EQUAL(dice.mean(), mean);
+                TEST_EQUAL(dice.variance(), square - mean * mean);
+            }
+        }
+    }
+
+    TRY(dice = Dice("2d6!!kh1"));
+    TRY(dist = dice.distribution());
+    TEST_NEAR(double(dice.mean()), dist.mean(), 1e-9);
+    TEST_NEAR(dice.sd(), dist.sd(), 1e-9);
+    TEST_NEAR(dist.pmf(1), 1.0 / 36, 1e-12);
+    TEST_NEAR(dist.pmf(7), (1.0 / 36) * (1.0 / 36) + 2 * (1.0 / 36) * (5.0 / 6), 1e-12);
+
+    TEST_EQUAL(dice.tolerance(), Dice::default_tolerance);
+    TRY(dice.set_tolerance(1e-3));
+    TEST_EQUAL(dice.tolerance(), 1e-3);
+    TRY(dist = dice.distribution());
+    TEST(dist.max() < 100);
+    TEST_THROW(dice.set_tolerance(0), std::invalid_argument);
+    TEST_THROW(dice.set_tolerance(1), std::invalid_argument);
+
+    for (auto [x, y]: {std::pair{"d6r1", "d6"}, {"d6!", "d6"}, {"d6!!", "d6!"}, {"d6r1", "d6r2"},
+            {"d6r1r2", "d6r1"}, {"d6r1r6", "d6r2"}, {"3d6!r1", "2d6!!"}}) {
+        Dice a, b;
+        TRY(a = Dice(x) + Dice(y));
+        TRY(b = Dice(y) + Dice(x));
+        TEST_EQUAL(a.str(), b.str());
+        TEST(a == b);
+        TRY(a = Dice(std::string(x) + "+" + y));
+        TEST_EQUAL(a.str(), b.str());
+        TEST(a == b);
+    }
+    TRY(dice = Dice("d6r1+d6"));
+    TEST_EQUAL(dice.str(), "d6+d6r1");
+    TRY(dice = Dice("d6!+d6r1r2+d6r1+d6!!"));
+    TEST_EQUAL(dice.str(), "d6r1+d6r1r2+d6!+d6!!");
+
+    for (auto pattern: {"3d6!", "d6r1r6", "4d6r1kh3", "4d6!!kh3", "3d8!!r8kl2"}) {
+        for (auto mode: {Dice::sampling_mode::roll, Dice::sampling_mode::table}) {
+            TRY(dice = Dice(pattern));
+            TRY(dice.set_sampling(mode));
+            stats = {};
+            for (int i = 0; i < iterations; ++i) {
+                Rational x;
+                TRY(x = dice(rng));
+                stats.add(double(x));
+            }
+            TEST(stats.min() >= double(dice.min()));
+            TEST(stats.max() <= double(dice.max()));
+            TEST_NEAR(stats.mean(), double(dice.mean()), 0.05);
+            TEST_NEAR(stats.sd(), dice.sd(), 0.05);
+        }
+    }
+
+}
+
+void test_dice_success_pools() {
+
+    static constexpr int iterations = 100'000;
+
+    Dice dice;
+    std::mt19937 rng(42);
+    Statistics stats;
+    Distribution dist;
+
+    TRY(dice = Dice("12d10>=8"));
+    TEST_EQUAL(dice.str(), "12d10>=8");
+    TEST_EQUAL(dice.min(), 0);
+    TEST_EQUAL(dice.max(), 12);
+    TEST_EQUAL(dice.mean(), Rational(18, 5));
+    TEST_EQUAL(dice.variance(), Rational(63, 25));
+    TRY(dice = Dice("12d10>7"));
+    TEST_EQUAL(dice.str(), "12d10>=8");
+    TRY(dice = Dice("12d10 < 3"));
+    TEST_EQUAL(dice.str(), "12d10<=2");
+    TEST_EQUAL(dice.mean(), Rational(12, 5));
+    TRY(dice = Dice("6d6r6>=5"));
+    TEST_EQUAL(dice.str(), "6d6r6>=5");
+    TEST_EQUAL(dice.mean(), Rational(6, 5));
+    TRY(dice = Dice("5d6>=1"));
+    TEST_EQUAL(dice.min(), 5);
+    TEST_EQUAL(dice.max(), 5);
+    TRY(dice = Dice("5d6>=7"));
+    TEST_EQUAL(dice.min(), 0);
+    TEST_EQUAL(dice.max(), 0);
+    TRY(dice = Dice("10d10>=8+5d10>=8+d10>=9x2-1"));
+    TEST_EQUAL(dice.str(), "15d10>=8+d10>=9*2-1");
+    TEST_EQUAL(dice.mean(), Rational(39, 10));
+
+    TEST_THROW(Dice("d6>="), std::invalid_argument);
+    TEST_THROW(Dice("d6>=3>=4"), std::invalid_argument);
+    TEST_THROW(Dice("d6>=3<2"), std::invalid_argument);
+    TEST_THROW(Dice("4d6kh3>=4"), std::invalid_argument);
+    TEST_THROW(Dice("4d6!>=4"), std::invalid_argument);
+    TEST_THROW(Dice("4d6!!>=4"), std::invalid_argument);
+
+    TRY(dice = Dice("12d10>=8"));
+    TRY(dist = dice.distribution());
+    TEST_EQUAL(dist.min(), 0);
+    TEST_EQUAL(dist.max(), 12);
+    TEST_NEAR(dist.pmf(0), std::pow(0.7, 12), 1e-12);
+    TEST_NEAR(dist.pmf(1), 12 * 0.3 * std::pow(0.7, 11), 1e-12);
+    TEST_NEAR(dist.pmf(12), std::pow(0.3, 12), 1e-12);
+
+    for (auto [x, y]: {std::pair{"5d10>=8", "5d10<=3"}, {"5d10>=8", "5d10>=7"}, {"5d10<=3", "5d10<=2"},
+            {"5d10>=8", "d10"}, {"5d10r1>=8", "5d10>=8"}}) {
+        Dice a, b;
+        TRY(a = Dice(x) + Dice(y));
+        TRY(b = Dice(y) + Dice(x));
+        TEST_EQUAL(a.str(), b.str());
+        TEST(a == b);
+        TRY(a = Dice(std::string(x) + "-" + y));
+        TRY(b = - Dice(y) + Dice(x));
+        TEST_EQUAL(a.str(), b.str());
+        TEST(a == b);
+    }
+    TRY(dice = Dice("5d10>=8+5d10<=3+d10"));
+    TEST_EQUAL(dice.str(), "d10+5d10>=8+5d10<=3");
+
+    for (auto pattern: {"12d10>=8", "500d10>=8", "100d6r1<=2", "10000d20>=2"}) {
+        TRY(dice = Dice(pattern));
+        stats = {};
+        for (int i = 0; i < iterations; ++i) {
+            Rational x;
+            TRY(x = dice(rng));
+            stats.add(double(x));
+        }
+        TEST(stats.min() >= double(dice.min()));
+        TEST(stats.max() <= double(dice.max()));
+        TEST_NEAR(stats.mean(), double(dice.mean()), 0.02 * dice.sd());
+        TEST_NEAR(stats.sd(), dice.sd(), 0.02 * dice.sd());
+    }
+
+}
+
+void test_dice_comparison() {
+
+    Dice a, b;
+    Dice::comparison c;
+    Distribution dist;
+
+    TRY(a = Dice(1, 6));
+    TRY(c = a.compare(a));
+    TEST_NEAR(c.win, 15.0 / 36, 1e-12);
+    TEST_NEAR(c.tie, 6.0 / 36, 1e-12);
+    TEST_NEAR(c.loss, 15.0 / 36, 1e-12);
+    TRY(dist = a.margin(a));
+    TEST_EQUAL(dist.min(), -5);
+    TEST_EQUAL(dist.max(), 5);
+    TEST_NEAR(dist.pmf(0), 6.0 / 36, 1e-12);
+    TEST_NEAR(dist.pmf(-3), 3.0 / 36, 1e-12);
+
+    // Compare against every combination of rolls
+
+    TRY(a = Dice("3d6+2"));
+    TRY(b = Dice("2d10"));
+    int win = 0, tie = 0, loss = 0;
+    for (int i = 0; i < 216; ++i) {
+        auto x = i % 6 + i / 6 % 6 + i / 36 + 5;
+        for (int j = 0; j < 100; ++j) {
+            auto y = j % 10 + j / 10 + 2;
+            if (x > y)
+                ++win;
+            else if (x == y)
+                ++tie;
+            else
+                ++loss;
+        }
+    }
+    TRY(c = a.compare(b));
+    TEST_NEAR(c.win, win / 21600.0, 1e-12);
+    TEST_NEAR(c.tie, tie / 21600.0, 1e-12);
+    TEST_NEAR(c.loss, loss / 21600.0, 1e-12);
+    TRY(c = b.compare(a));
+    TEST_NEAR(c.win, loss / 21600.0, 1e-12);
+    TEST_NEAR(c.loss, win / 21600.0, 1e-12);
+    TRY(dist = a.margin(b));
+    TEST_EQUAL(dist.min(), -15);
+    TEST_EQUAL(dist.max(), 18);
+    TEST_NEAR(dist.mean(), 1.5, 1e-12);
+
+    // Fractional results, where zero may not be a possible margin
+
+    TRY(a = Dice("d6/2"));
+    TRY(b = Dice("d4/3+1/5"));
+    win = tie = loss = 0;
+    for (int i = 1; i <= 6; ++i) {
+        for (int j = 1; j <= 4; ++j) {
+            auto x = Rational(i, 2), y = Rational(j, 3) + Rational(1, 5);
+            if (x > y)
+                ++win;
+            else if (x == y)
+                ++tie;
+            else
+                ++loss;
+        }
+    }
+    TRY(c = a.compare(b));
+    TEST_NEAR(c.win, win / 24.0, 1e-12);
+    TEST_EQUAL(c.tie, 0);
+    TEST_NEAR(c.loss, loss / 24.0, 1e-12);
+
+    // Modified dice
+
+    TRY(a = Dice("4d6kh3"));
+    TRY(b = Dice("3d6"));
+    auto counts = brute_force_keep(4, 6, 3, true);
+    win = tie = loss = 0;
+    for (int x = 3; x <= 18; ++x) {
+        for (int i = 0; i < 216; ++i) {
+            auto y = i % 6 + i / 6 % 6 + i / 36 + 3;
+            if (x > y)
+                win += counts[x];
+            else if (x == y)
+                tie += counts[x];
+            else
+                loss += counts[x];
+        }
+    }
+    TRY(c = a.compare(b));
+    TEST_NEAR(c.win, win / 279936.0, 1e-12);
+    TEST_NEAR(c.tie, tie / 279936.0, 1e-12);
+    TEST_NEAR(c.loss, loss / 279936.0, 1e-12);
+
+    // Tiny probabilities are not lost in convolution noise
+
+    TRY(c = Dice("100d6").compare(Dice("100d6+300")));
+    TEST(c.win >= 0 && c.win < 1e-20);
+    TEST(c.tie >= 0 && c.tie < 1e-20);
+    TEST_NEAR(c.loss, 1, 1e-12);
+    TRY(c = Dice("100d6").compare(Dice("100d6+100")));
+    TEST(c.win > 1e-6 && c.win < 1e-3);
+    TEST_NEAR(c.win + c.tie + c.loss, 1, 1e-12);
+
+    TRY(c = Dice("2d6+5").compare(Dice("6")));
+    TEST_EQUAL(c.win, 1);
+    TEST_EQUAL(c.tie, 0);
+    TEST_EQUAL(c.loss, 0);
+
+}
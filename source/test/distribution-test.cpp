@@ -0,0 +1,211 @@
+#include "dice/distribution.hpp"
+#include "dice/rational.hpp"
+#include "unit-test.hpp"
+#include <cmath>
+#include <stdexcept>
+
+void test_distribution_construction() {
+
+    Distribution d;
+
+    TEST_EQUAL(d.size(), 1u);
+    TEST_EQUAL(d.min(), 0);
+    TEST_EQUAL(d.max(), 0);
+    TEST_EQUAL(d.mean(), 0);
+    TEST_EQUAL(d.variance(), 0);
+    TEST_EQUAL(d.pmf(0), 1);
+    TEST_EQUAL(d.pmf(1), 0);
+
+    TRY(d = Distribution(Rational(5, 2)));
+    TEST_EQUAL(d.size(), 1u);
+    TEST_EQUAL(d.min(), Rational(5, 2));
+    TEST_EQUAL(d.max(), Rational(5, 2));
+    TEST_EQUAL(d.pmf(Rational(5, 2)), 1);
+    TEST_EQUAL(d.cdf(2), 0);
+    TEST_EQUAL(d.cdf(3), 1);
+
+    TRY(d = Distribution::uniform(1, 6));
+    TEST_EQUAL(d.size(), 6u);
+    TEST_EQUAL(d.min(), 1);
+    TEST_EQUAL(d.max(), 6);
+    TEST_NEAR(d.mean(), 3.5, 1e-12);
+    TEST_NEAR(d.variance(), 35.0 / 12, 1e-12);
+    TEST_NEAR(d.pmf(0), 0, 1e-12);
+    TEST_NEAR(d.pmf(1), 1.0 / 6, 1e-12);
+    TEST_NEAR(d.pmf(6), 1.0 / 6, 1e-12);
+    TEST_NEAR(d.pmf(Rational(7, 2)), 0, 1e-12);
+    TEST_NEAR(d.cdf(3), 0.5, 1e-12);
+    TEST_NEAR(d.cdf(Rational(7, 2)), 0.5, 1e-12);
+
+    TEST_THROW(Distribution::uniform(6, 1), std::invalid_argument);
+    TEST_THROW(Distribution::uniform(1, 1'000'000'000), std::length_error);
+
+    TRY(d = Distribution::weighted(-2, {0, 0, 1, 2, 0, 1, 0}));
+    TEST_EQUAL(d.size(), 4u);
+    TEST_EQUAL(d.min(), 0);
+    TEST_EQUAL(d.max(), 3);
+    TEST_NEAR(d.pmf(0), 0.25, 1e-12);
+    TEST_NEAR(d.pmf(1), 0.5, 1e-12);
+    TEST_NEAR(d.pmf(2), 0, 1e-12);
+    TEST_NEAR(d.pmf(3), 0.25, 1e-12);
+    TEST_THROW(Distribution::weighted(1, {}), std::invalid_argument);
+    TEST_THROW(Distribution::weighted(1, {0, 0}), std::invalid_argument);
+    TEST_THROW(Distribution::weighted(1, {1, -1}), std::invalid_argument);
+
+    TRY(d = Distribution::keep_highest(Distribution::weighted(0, {1, 1}), 2, 1));
+    TEST_EQUAL(d.min(), 0);
+    TEST_EQUAL(d.max(), 1);
+    TEST_NEAR(d.pmf(1), 0.75, 1e-12);
+    TRY(d = Distribution::keep_lowest(Distribution::weighted(0, {1, 1}), 2, 1));
+    TEST_NEAR(d.pmf(1), 0.25, 1e-12);
+    TRY(d = Distribution::keep_highest(4, 6, 3));
+    TEST_EQUAL(d.min(), 3);
+    TEST_EQUAL(d.max(), 18);
+    TEST_NEAR(d.mean(), 15869.0 / 1296, 1e-12);
+    TEST_THROW(Distribution::keep_highest(Distribution::uniform(1, 6) / 2, 2, 1), std::invalid_argument);
+
+}
+
+void test_distribution_arithmetic() {
+
+    Distribution a, b, c;
+
+    TRY(a = Distribution::uniform(1, 6));
+    TRY(b = Distribution::uniform(1, 4));
+
+    TRY(c = a + b);
+    TEST_EQUAL(c.size(), 9u);
+    TEST_EQUAL(c.min(), 2);
+    TEST_EQUAL(c.max(), 10);
+    TEST_NEAR(c.pmf(2), 1.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(5), 4.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(7), 4.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(10), 1.0 / 24, 1e-12);
+
+    TRY(c = a - b);
+    TEST_EQUAL(c.min(), -3);
+    TEST_EQUAL(c.max(), 5);
+    TEST_NEAR(c.pmf(-3), 1.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(0), 4.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(5), 1.0 / 24, 1e-12);
+
+    TRY(c = a * Rational(-3, 2) + 10);
+    TEST_EQUAL(c.size(), 6u);
+    TEST_EQUAL(c.min(), 1);
+    TEST_EQUAL(c.max(), Rational(17, 2));
+    TEST_NEAR(c.pmf(1), 1.0 / 6, 1e-12);
+    TEST_NEAR(c.pmf(2), 0, 1e-12);
+    TEST_NEAR(c.pmf(Rational(5, 2)), 1.0 / 6, 1e-12);
+    TEST_NEAR(c.mean(), 19.0 / 4, 1e-12);
+
+    TRY(c = a * 2 + b * 3);
+    TEST_EQUAL(c.min(), 5);
+    TEST_EQUAL(c.max(), 24);
+    TEST_EQUAL(c.size(), 20u);
+    TEST_NEAR(c.pmf(5), 1.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(6), 0, 1e-12);
+    TEST_NEAR(c.pmf(7), 1.0 / 24, 1e-12);
+    TEST_NEAR(c.pmf(8), 1.0 / 24, 1e-12);
+    TEST_NEAR(c.mean(), 14.5, 1e-12);
+
+    TRY(c = a * 0);
+    TEST_EQUAL(c.size(), 1u);
+    TEST_EQUAL(c.min(), 0);
+
+    TRY(c = a.power(0));
+    TEST_EQUAL(c.size(), 1u);
+    TEST_EQUAL(c.min(), 0);
+
+    TRY(c = a.power(3));
+    TEST_EQUAL(c.size(), 16u);
+    TEST_EQUAL(c.min(), 3);
+    TEST_EQUAL(c.max(), 18);
+    TEST_NEAR(c.pmf(3), 1.0 / 216, 1e-12);
+    TEST_NEAR(c.pmf(10), 27.0 / 216, 1e-12);
+    TEST_NEAR(c.mean(), 10.5, 1e-12);
+    TEST_NEAR(c.variance(), 35.0 / 4, 1e-12);
+
+    TEST_THROW(a.power(-1), std::invalid_argument);
+
+}
+
+void test_distribution_queries() {
+
+    Distribution d;
+
+    TRY(d = Distribution::uniform(1, 6).power(2));
+
+    TEST_NEAR(d.cdf(1), 0, 1e-12);
+    TEST_NEAR(d.cdf(2), 1.0 / 36, 1e-12);
+    TEST_NEAR(d.cdf(7), 21.0 / 36, 1e-12);
+    TEST_NEAR(d.cdf(Rational(15, 2)), 21.0 / 36, 1e-12);
+    TEST_NEAR(d.cdf(12), 1, 1e-12);
+    TEST_NEAR(d.cdf(100), 1, 1e-12);
+
+    TEST_EQUAL(d.quantile(0), 2);
+    TEST_EQUAL(d.quantile(0.01), 2);
+    TEST_EQUAL(d.quantile(0.5), 7);
+    TEST_EQUAL(d.quantile(0.99), 12);
+    TEST_EQUAL(d.quantile(1), 12);
+
+    TEST_THROW(d.quantile(-0.1), std::invalid_argument);
+    TEST_THROW(d.quantile(1.1), std::invalid_argument);
+
+    TEST_EQUAL(d.value(0), 2);
+    TEST_EQUAL(d.value(5), 7);
+    TEST_NEAR(d.probability(5), 6.0 / 36, 1e-12);
+    TEST_EQUAL(d.probability(100), 0);
+
+}
+
+void test_distribution_large_convolution() {
+
+    Distribution a, b, c;
+
+    TRY(a = Distribution::uniform(1, 6).power(200));
+    for (int i = 0; i < 200; ++i)
+        TRY(b += Distribution::uniform(1, 6));
+
+    TEST_EQUAL(a.size(), 1001u);
+    TEST_EQUAL(a.min(), 200);
+    TEST_EQUAL(a.max(), 1200);
+    TEST_NEAR(a.mean(), 700, 1e-9);
+    TEST_NEAR(a.variance(), 200 * 35.0 / 12, 1e-8);
+
+    for (int x = 200; x <= 1200; x += 50) {
+        TEST_NEAR(a.pmf(x), b.pmf(x), 1e-14);
+        TEST_NEAR(a.cdf(x), b.cdf(x), 1e-12);
+    }
+
+    // Tail probabilities below the rounding error of the FFT are zero
+
+    TRY(c = Distribution::uniform(1, 6).power(100));
+    TRY(b = Distribution());
+    for (int i = 0; i < 100; ++i)
+        TRY(b += Distribution::uniform(1, 6));
+    TEST_EQUAL(c.size(), 501u);
+    TEST_EQUAL(c.min(), 100);
+    TEST_EQUAL(c.max(), 600);
+    TEST_EQUAL(c.pmf(100), 0);
+    TEST_EQUAL(c.pmf(600), 0);
+    TEST_EQUAL(c.cdf(150), 0);
+    TEST(b.cdf(150) > 0);
+    TEST(b.cdf(150) < 1e-20);
+    for (int x = 100; x <= 600; x += 10)
+        TEST_NEAR(c.pmf(x), b.pmf(x), 1e-14);
+    TRY(c = Distribution::uniform(1, 6).power(100) - Distribution::uniform(1, 6).power(100));
+    TEST_EQUAL(c.cdf(-300), 0);
+    TEST_NEAR(c.cdf(0), 0.5 + c.pmf(0) / 2, 1e-12);
+
+    TRY(c = Distribution::uniform(1, 20).power(1000));
+    TEST_EQUAL(c.size(), 19001u);
+    TEST_NEAR(c.mean(), 10500, 1e-6);
+    TEST_NEAR(c.sd(), std::sqrt(1000 * 399.0 / 12), 1e-6);
+    TEST_EQUAL(c.quantile(0.5), 10500);
+
+    TRY(c = Distribution::uniform(1, 100).power(500) * 3 - Distribution::uniform(1, 8).power(300));
+    TEST_EQUAL(c.min(), 1500 - 2400);
+    TEST_EQUAL(c.max(), 150000 - 300);
+    TEST_NEAR(c.mean(), 500 * 50.5 * 3 - 300 * 4.5, 1e-6);
+
+}
@@ -0,0 +1,71 @@
+#include "dice/fixed-dice.hpp"
+#include "dice/dice.hpp"
+#include "dice/rational.hpp"
+#include "unit-test.hpp"
+#include <random>
+#include <stdexcept>
+
+void test_fixed_dice_construction() {
+
+    constexpr auto a = "3d6+2d10x5/2"_dice;
+    constexpr auto b = " 3*2d10 - 2d6/4 + d8*6/8 + 10\n"_dice;
+    constexpr auto c = ""_dice;
+    constexpr FixedDice<2> d("d6+d6+d8");
+
+    static_assert(a.groups() == 2);
+    static_assert(a.mean() == 38);
+    static_assert(a.min() == 8);
+    static_assert(a.max() == 68);
+    static_assert(a.variance() == Rational(895, 8));
+    static_assert(a.scale() == 2);
+    static_assert(! a.is_integral());
+    static_assert(b.groups() == 3);
+    static_assert(b.min() == Rational(55, 4));
+    static_assert(b.max() == Rational(151, 2));
+    static_assert(b.mean() == Rational(357, 8));
+    static_assert(c.groups() == 0);
+    static_assert(c.mean() == 0);
+    static_assert(c.is_integral());
+    static_assert(d.groups() == 2);
+    static_assert(d.max() == 20);
+
+    TEST_EQUAL(a.str(), "2d10*5/2+3d6");
+    TEST_EQUAL(a.str(), Dice("3d6+2d10x5/2").str());
+    TEST_EQUAL(b.str(), "2d10*3+d8*3/4-2d6/4+10");
+    TEST_EQUAL(c.str(), "0");
+    TEST_EQUAL(d.str(), "d8+2d6");
+    TEST_NEAR(b.sd(), 12.321433, 1e-6);
+
+    TEST_THROW(FixedDice<>("3d6+x"), std::invalid_argument);
+    TEST_THROW(FixedDice<>("d6/0"), std::invalid_argument);
+    TEST_THROW(FixedDice<2>("d4+d6+d8"), std::length_error);
+    TEST_THROW(FixedDice<>("4d6kh3"), std::invalid_argument);
+    TEST_THROW(FixedDice<>("d6!"), std::invalid_argument);
+    TEST_THROW(FixedDice<>("d6r1"), std::invalid_argument);
+
+}
+
+void test_fixed_dice_generation() {
+
+    static constexpr int iterations = 10'000;
+
+    constexpr auto a = "3d6+2d10x5/2-1"_dice;
+    constexpr auto b = "d6/3000000000+d6/3000000001"_dice;
+    Dice dice("3d6+2d10x5/2-1");
+    std::mt19937 rng1(42), rng2(42);
+    Rational x, y;
+
+    for (int i = 0; i < iterations; ++i) {
+        TRY(x = a(rng1));
+        TRY(y = dice(rng2));
+        TEST_EQUAL(x, y);
+        REQUIRE(x >= a.min() && x <= a.max());
+    }
+
+    static_assert(b.scale() == 9'000'000'003'000'000'000);
+    for (int i = 0; i < 100; ++i) {
+        TRY(x = b(rng1));
+        REQUIRE(x >= b.min() && x <= b.max());
+    }
+
+}
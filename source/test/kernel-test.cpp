@@ -0,0 +1,67 @@
+#include "dice/kernel.hpp"
+#include "unit-test.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using instruction_set = DiceKernel::instruction_set;
+
+void test_kernel_instruction_sets() {
+
+    static constexpr std::size_t n = 1000;
+
+    std::vector<uint32_t> expect(n), result(n);
+    auto best = DiceKernel::best();
+
+    for (auto faces: {1u, 6u, 20u, 3'000'000'000u}) {
+        for (auto n_dice: {0u, 1u, 3u}) {
+            if (! DiceKernel::supports(faces, n_dice))
+                continue;
+            DiceKernel k1(12345);
+            TRY(k1.roll(faces, n_dice, expect.data(), n, instruction_set::scalar));
+            TRY(k1.roll(faces, n_dice, expect.data(), n - 7, instruction_set::scalar));
+            for (auto is: {instruction_set::avx2, instruction_set::avx512}) {
+                if (is > best)
+                    continue;
+                DiceKernel k2(12345);
+                TRY(k2.roll(faces, n_dice, result.data(), n, is));
+                TRY(k2.roll(faces, n_dice, result.data(), n - 7, is));
+                TEST_EQUAL_RANGES(result, expect);
+            }
+        }
+    }
+
+}
+
+void test_kernel_distribution() {
+
+    static constexpr std::size_t n = 60'000;
+
+    DiceKernel k(42);
+    std::vector<uint32_t> sums(n);
+    std::vector<int> counts(7, 0);
+
+    TRY(k.roll(6, 1, sums.data(), n));
+    for (auto x: sums) {
+        REQUIRE(x >= 1 && x <= 6);
+        ++counts[x];
+    }
+    for (int i = 1; i <= 6; ++i)
+        TEST_NEAR(counts[i], 10'000, 400);
+
+    TRY(k.roll(10, 100, sums.data(), n));
+    double sum = 0;
+    for (auto x: sums) {
+        REQUIRE(x >= 100 && x <= 1000);
+        sum += x;
+    }
+    TEST_NEAR(sum / n, 550, 0.5);
+
+    TEST(DiceKernel::supports(6, 1'000'000));
+    TEST(DiceKernel::supports(4'294'967'295, 1));
+    TEST(! DiceKernel::supports(4'294'967'296, 1));
+    TEST(! DiceKernel::supports(6, 1'000'000'000));
+    TEST(! DiceKernel::supports(0, 1));
+    TEST_THROW(k.roll(0, 1, sums.data(), n), std::invalid_argument);
+
+}
@@ -0,0 +1,76 @@
+#include "dice/output-buffer.hpp"
+#include "dice/rational.hpp"
+#include "unit-test.hpp"
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+void test_output_buffer_text() {
+
+    OutputBuffer out(4);
+
+    TEST(out.empty());
+    TRY(out.write("Hello"));
+    TRY(out.write(' '));
+    TRY(out.write_integer(42));
+    TRY(out.write(' '));
+    TRY(out.write_integer(-1234567890123456789));
+    TEST_EQUAL(out.view(), "Hello 42 -1234567890123456789");
+    TEST_EQUAL(out.size(), 29u);
+    TRY(out.clear());
+    TEST(out.empty());
+
+    TRY(out.write_integer(INT64_MIN));
+    TRY(out.write(' '));
+    TRY(out.write_integer(INT64_MAX));
+    TEST_EQUAL(out.view(), "-9223372036854775808 9223372036854775807");
+
+}
+
+void test_output_buffer_numbers() {
+
+    OutputBuffer out;
+
+    std::vector<double> decimals = {0, 1, -1, 0.5, 1.0 / 3, 2.0 / 3, 1e-5, 123456, 1234567, -9.876543e21, 1e300};
+
+    for (auto x: decimals) {
+        std::ostringstream expect;
+        expect << x;
+        TRY(out.clear());
+        TRY(out.write_decimal(x));
+        TEST_EQUAL(out.view(), expect.str());
+    }
+
+    std::vector<Rational> rationals = {0, 1, -1, 42, Rational(1, 2), Rational(-1, 2), Rational(22, 7), Rational(-22, 7),
+        Rational(INT64_MAX, 2), Rational(INT64_MIN + 1, 3)};
+
+    for (auto& r: rationals) {
+        TRY(out.clear());
+        TRY(out.write_fraction(r));
+        TEST_EQUAL(out.view(), r.str());
+        TRY(out.clear());
+        TRY(out.write_mixed(r));
+        TEST_EQUAL(out.view(), r.mixed());
+    }
+
+}
+
+void test_output_buffer_binary() {
+
+    OutputBuffer out;
+    int64_t i = 0;
+    double x = 0;
+
+    TRY(out.write_binary(Rational(-22, 7)));
+    TRY(out.write_binary(0.25));
+    REQUIRE(out.size() == 24u);
+    std::memcpy(&i, out.data(), 8);
+    TEST_EQUAL(i, -22);
+    std::memcpy(&i, out.data() + 8, 8);
+    TEST_EQUAL(i, 7);
+    std::memcpy(&x, out.data() + 16, 8);
+    TEST_EQUAL(x, 0.25);
+
+}
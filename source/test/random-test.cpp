@@ -0,0 +1,189 @@
+#include "dice/random.hpp"
+#include "unit-test.hpp"
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+void test_random_bits() {
+
+    TEST_EQUAL(random_engine_bits<std::minstd_rand>(), 30);
+    TEST_EQUAL(random_engine_bits<std::mt19937>(), 32);
+    TEST_EQUAL(random_engine_bits<std::mt19937_64>(), 64);
+    TEST_EQUAL(random_engine_bits<std::ranlux24>(), 24);
+
+    std::mt19937 rng32(42);
+    std::mt19937_64 rng64(42);
+
+    TEST_EQUAL(random_bits32(rng32), 1'608'637'542u);
+    TEST_EQUAL(random_bits32(rng32), 3'421'126'067u);
+    TEST_EQUAL(random_bits32(rng32), 4'083'286'876u);
+    TEST_EQUAL(random_bits64(rng64), 13'930'160'852'258'120'406ull);
+    TEST_EQUAL(random_bits64(rng64), 11'788'048'577'503'494'824ull);
+
+    double x = 0;
+
+    for (int i = 0; i < 1000; ++i) {
+        TRY(x = random_unit(rng32));
+        TEST(x >= 0);
+        TEST(x < 1);
+    }
+
+}
+
+void test_random_uniform_integer() {
+
+    static constexpr int iterations = 100'000;
+
+    UniformInteger dist;
+    std::minstd_rand rng(42);
+    std::vector<int> counts;
+    std::vector<int64_t> values, expect;
+    int64_t x = 0;
+
+    TEST_EQUAL(dist.a(), 0);
+    TEST_EQUAL(dist.b(), 0);
+    TEST_EQUAL(dist(rng), 0);
+
+    TRY(dist = UniformInteger(1, 6));
+    TEST_EQUAL(dist.a(), 1);
+    TEST_EQUAL(dist.b(), 6);
+    for (int i = 0; i < 10; ++i)
+        TRY(values.push_back(dist(rng)));
+    expect = {3, 4, 2, 6, 6, 5, 6, 2, 4, 5};
+    TEST_EQUAL_RANGES(values, expect);
+
+    counts.assign(6, 0);
+    for (int i = 0; i < iterations; ++i) {
+        TRY(x = dist(rng));
+        REQUIRE(x >= 1 && x <= 6);
+        ++counts[x - 1];
+    }
+    for (auto n: counts)
+        TEST_NEAR(double(n) / iterations, 1.0 / 6, 0.006);
+
+    std::mt19937 rng32(42);
+
+    values.clear();
+    TRY(dist = UniformInteger(-1'000'000'000'000, 1'000'000'000'000));
+    for (int i = 0; i < 3; ++i)
+        TRY(values.push_back(dist(rng32)));
+    expect = {-250'919'771'010, 901'428'623'211, 463'987'877'024};
+    TEST_EQUAL_RANGES(values, expect);
+
+    TRY(dist = UniformInteger(INT64_MIN, INT64_MAX));
+    for (int i = 0; i < 1000; ++i)
+        TRY(dist(rng32));
+
+    TEST_THROW(UniformInteger(6, 1), std::invalid_argument);
+
+}
+
+void test_random_binomial_integer() {
+
+    static constexpr int iterations = 100'000;
+
+    struct test_case { int64_t n; double p; };
+    const test_case cases[] = {
+        {1, 0.5}, {10, 0.1}, {12, 0.3}, {40, 0.2}, {100, 0.5}, {300, 0.9}, {1000, 0.05},
+    };
+
+    BinomialInteger dist;
+    std::mt19937 rng(42);
+    std::vector<int> counts;
+    int64_t x = 0;
+
+    TEST_EQUAL(dist.n(), 0);
+    TEST_EQUAL(dist(rng), 0);
+
+    for (auto& tc: cases) {
+        TRY(dist = BinomialInteger(tc.n, tc.p));
+        TEST_EQUAL(dist.n(), tc.n);
+        TEST_EQUAL(dist.p(), tc.p);
+        counts.assign(std::size_t(tc.n + 1), 0);
+        for (int i = 0; i < iterations; ++i) {
+            TRY(x = dist(rng));
+            REQUIRE(x >= 0 && x <= tc.n);
+            ++counts[std::size_t(x)];
+        }
+        double sum = 0, sum2 = 0;
+        for (int64_t k = 0; k <= tc.n; ++k) {
+            auto expect = std::exp(std::lgamma(double(tc.n + 1)) - std::lgamma(double(k + 1)) - std::lgamma(double(tc.n - k + 1))
+                + double(k) * std::log(tc.p) + double(tc.n - k) * std::log(1 - tc.p));
+            auto observed = double(counts[std::size_t(k)]) / iterations;
+            TEST_NEAR(observed, expect, 4 * std::sqrt(expect / iterations) + 1e-4);
+            sum += double(k) * observed;
+            sum2 += double(k) * double(k) * observed;
+        }
+        auto mean = double(tc.n) * tc.p;
+        auto sd = std::sqrt(mean * (1 - tc.p));
+        TEST_NEAR(sum, mean, 0.02 * sd + 1e-3);
+        TEST_NEAR(std::sqrt(sum2 - sum * sum), sd, 0.02 * sd + 1e-3);
+    }
+
+    TRY(dist = BinomialInteger(50, 0));
+    TEST_EQUAL(dist(rng), 0);
+    TRY(dist = BinomialInteger(50, 1));
+    TEST_EQUAL(dist(rng), 50);
+    TRY(dist = BinomialInteger(1'000'000'000'000, 0.25));
+    TRY(x = dist(rng));
+    TEST_NEAR(double(x), 2.5e11, 1e7);
+
+    TEST_THROW(BinomialInteger(-1, 0.5), std::invalid_argument);
+    TEST_THROW(BinomialInteger(10, 1.5), std::invalid_argument);
+
+}
+
+void test_random_philox() {
+
+    // Known answer tests from the Random123 distribution
+
+    using block = Philox::block_type;
+
+    block expect;
+
+    expect = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+    TEST(Philox::generate({0, 0, 0, 0}, 0) == expect);
+    expect = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+    TEST(Philox::generate({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, 0xffffffff'ffffffffull) == expect);
+    expect = {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+    TEST(Philox::generate({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, 0x299f31d0'a4093822ull) == expect);
+
+    Philox rng(42, 7), copy(42, 7), other(42, 8);
+    std::vector<uint32_t> seq;
+
+    TEST_EQUAL(rng.seed(), 42u);
+    TEST_EQUAL(rng.stream(), 7u);
+    TEST_EQUAL(random_engine_bits<Philox>(), 32);
+
+    for (int i = 0; i < 20; ++i)
+        seq.push_back(rng());
+    TEST_EQUAL(rng.tell(), 20u);
+
+    for (int i = 0; i < 20; ++i)
+        TEST_EQUAL(copy(), seq[i]);
+
+    int same = 0;
+    for (int i = 0; i < 20; ++i)
+        same += int(other() == seq[i]);
+    TEST(same < 2);
+
+    for (int i = 19; i >= 0; --i) {
+        TRY(rng.seek(uint64_t(i)));
+        TEST_EQUAL(rng(), seq[i]);
+    }
+
+    TRY(rng.seek(0));
+    TRY(rng.discard(13));
+    TEST_EQUAL(rng(), seq[13]);
+    TRY(rng.discard(3));
+    TEST_EQUAL(rng(), seq[17]);
+
+    UniformInteger dist(1, 6);
+    TRY(rng.seek(1'000'000'000'000ull));
+    auto x = dist(rng);
+    TRY(rng.seek(1'000'000'000'000ull));
+    TEST_EQUAL(dist(rng), x);
+
+}
@@ -1,5 +1,6 @@
 #include "dice/rational.hpp"
 #include "unit-test.hpp"
+#include <limits>
 #include <stdexcept>
 
 void test_rational_construction() {
@@ -135,3 +136,55 @@ void test_rational_conversion() {
     TRY((r = {8, 4}));   TEST_EQUAL(r.round(), 2);   TEST_EQUAL(r.floor(), 2);   TEST_EQUAL(r.ceil(), 2);
 
 }
+
+void test_rational_overflow() {
+
+    static constexpr auto max = std::numeric_limits<Rational::integer_type>::max();
+    static constexpr auto min = std::numeric_limits<Rational::integer_type>::min();
+
+    Rational x, y, z;
+
+    TRY((x = {1'000'000'000'000, 999'999'999'989}));
+    TRY((y = {999'999'999'989, 1'000'000'000'000}));
+    TRY(z = x * y);                TEST_EQUAL(z, 1);
+    TRY(z = x / x);                TEST_EQUAL(z, 1);
+    TRY(z = x - x);                TEST_EQUAL(z, 0);
+
+    TRY((x = {1, 3'000'000'000}));
+    TRY((y = {1, 3'000'000'001}));
+    TRY(z = x + y);                TEST_EQUAL(z.str(), "6000000001/9000000003000000000");
+    TRY(z = x - y);                TEST_EQUAL(z.str(), "1/9000000003000000000");
+
+    TRY((x = {max, 3}));
+    TRY((y = {max, 2}));
+    TEST(x < y);
+    TEST(- y < - x);
+    TEST(Rational(min) < Rational(max));
+    TRY(z = y * 2);                TEST_EQUAL(z, max);
+    TRY(z = y - x);                TEST_EQUAL(z, Rational(max, 6));
+
+    TEST_EQUAL(y.round(), 4'611'686'018'427'387'904);
+    TEST_EQUAL(y.floor(), 4'611'686'018'427'387'903);
+    TEST_EQUAL(y.ceil(), 4'611'686'018'427'387'904);
+    TEST_EQUAL((- y).round(), -4'611'686'018'427'387'903);
+
+    TEST(! Rational::checked());
+    TRY(z = Rational(max) + 1);
+    TRY(z = - Rational(min));
+
+    TRY(Rational::set_checked(true));
+    TEST(Rational::checked());
+    TEST_THROW(Rational(max) + 1, std::overflow_error);
+    TEST_THROW(Rational(min) - 1, std::overflow_error);
+    TEST_THROW(Rational(max) * 2, std::overflow_error);
+    TEST_THROW(Rational(1, max) / 2, std::overflow_error);
+    TEST_THROW(- Rational(min), std::overflow_error);
+    TEST_THROW(Rational(min).abs(), std::overflow_error);
+    TEST_THROW(Rational(min, -1), std::overflow_error);
+    TRY(z = Rational(max) + Rational(min));
+    TEST_EQUAL(z, -1);
+    TRY(z = Rational(max, 2) * 2);
+    TEST_EQUAL(z, max);
+    TRY(Rational::set_checked(false));
+
+}
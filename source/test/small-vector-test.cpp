@@ -0,0 +1,97 @@
+#include "dice/small-vector.hpp"
+#include "unit-test.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace {
+
+    using Vec = SmallVector<std::string, 3>;
+
+    std::string join(const Vec& v) {
+        std::string s;
+        for (auto& x: v)
+            s += x + ";";
+        return s;
+    }
+
+}
+
+void test_small_vector_insertion() {
+
+    Vec v;
+
+    TEST(v.empty());
+    TEST(v.is_inline());
+    TEST_EQUAL(v.capacity(), 3u);
+
+    TRY(v.push_back("b"));
+    TRY(v.push_back("d"));
+    TRY(v.insert(v.begin(), "a"));
+    TEST_EQUAL(join(v), "a;b;d;");
+    TEST(v.is_inline());
+
+    TRY(v.insert(v.begin() + 2, "c"));
+    TEST_EQUAL(join(v), "a;b;c;d;");
+    TEST(! v.is_inline());
+    TEST(v.capacity() >= 4u);
+
+    TRY(v.push_back(v[0]));
+    TEST_EQUAL(join(v), "a;b;c;d;a;");
+    TRY(v.insert(v.begin(), v[4]));
+    TEST_EQUAL(join(v), "a;a;b;c;d;a;");
+
+    TRY(v.erase(v.begin() + 1));
+    TEST_EQUAL(join(v), "a;b;c;d;a;");
+    TRY(v.erase(v.end() - 1));
+    TEST_EQUAL(join(v), "a;b;c;d;");
+    TEST_EQUAL(v.size(), 4u);
+
+    TRY(v.clear());
+    TEST(v.empty());
+    TEST_EQUAL(join(v), "");
+
+}
+
+void test_small_vector_copy_move() {
+
+    Vec a, b, c;
+
+    TRY(a.push_back("x"));
+    TRY(a.push_back("y"));
+
+    TRY(b = a);
+    TEST_EQUAL(join(b), "x;y;");
+    TEST(b.is_inline());
+    TRY(c = std::move(a));
+    TEST_EQUAL(join(c), "x;y;");
+    TEST(c.is_inline());
+    TEST(a.empty());
+
+    TRY(c.push_back("z"));
+    TRY(c.push_back("w"));
+    TEST(! c.is_inline());
+    auto ptr = c.data();
+    TRY(b = std::move(c));
+    TEST_EQUAL(join(b), "x;y;z;w;");
+    TEST(b.data() == ptr);
+    TEST(c.empty());
+    TEST(c.is_inline());
+
+    Vec d(b);
+    TEST_EQUAL(join(d), "x;y;z;w;");
+    TRY(d = d);
+    TEST_EQUAL(join(d), "x;y;z;w;");
+    TRY(d = Vec());
+    TEST(d.empty());
+    TEST(d.is_inline());
+
+    SmallVector<std::unique_ptr<int>, 2> u;
+    for (int i = 0; i < 5; ++i)
+        TRY(u.push_back(std::make_unique<int>(i)));
+    TEST_EQUAL(u.size(), 5u);
+    for (std::size_t i = 0; i < u.size(); ++i)
+        TEST_EQUAL(*u[i], int(i));
+
+}
@@ -0,0 +1,105 @@
+#include "dice/dice.hpp"
+#include "dice/rational.hpp"
+#include "dice/statistics.hpp"
+#include "unit-test.hpp"
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+void test_statistics_exact() {
+
+    RollStatistics stats;
+
+    TRY(stats = RollStatistics(Dice("2d6")));
+    TEST(stats.is_exact());
+    TEST_EQUAL(stats.bins(), 11u);
+    TEST_EQUAL(stats.bin_value(0), 2);
+    TEST_EQUAL(stats.bin_value(10), 12);
+    TEST_EQUAL(stats.count(), 0u);
+
+    for (int i = 1; i <= 6; ++i)
+        for (int j = 1; j <= 6; ++j)
+            TRY(stats.add(i + j));
+
+    TEST_EQUAL(stats.count(), 36u);
+    TEST_EQUAL(stats.min(), 2);
+    TEST_EQUAL(stats.max(), 12);
+    TEST_NEAR(stats.mean(), 7, 1e-12);
+    TEST_NEAR(stats.variance(), 35.0 / 6 * 36 / 35, 1e-12);
+    TEST_EQUAL(stats.bin_count(0), 1u);
+    TEST_EQUAL(stats.bin_count(5), 6u);
+    TEST_EQUAL(stats.bin_count(10), 1u);
+    TEST_EQUAL(stats.percentile(0), 2);
+    TEST_EQUAL(stats.percentile(50), 7);
+    TEST_EQUAL(stats.percentile(100), 12);
+    TEST_EQUAL(stats.percentile(1.0 / 36 * 100), 2);
+    TEST_EQUAL(stats.percentile(2.0 / 36 * 100), 3);
+
+    TRY(stats = RollStatistics(Dice("d6/3")));
+    TEST(stats.is_exact());
+    TEST_EQUAL(stats.bins(), 6u);
+    TRY(stats.add(Rational(2, 3)));
+    TRY(stats.add(Rational(5, 3)));
+    TEST_EQUAL(stats.bin_count(1), 1u);
+    TEST_EQUAL(stats.bin_count(4), 1u);
+    TEST_EQUAL(stats.min(), Rational(2, 3));
+    TEST_EQUAL(stats.max(), Rational(5, 3));
+
+    TEST_THROW(RollStatistics(2, 1), std::invalid_argument);
+    TEST_THROW(stats.percentile(101), std::invalid_argument);
+    TEST_THROW(RollStatistics().percentile(50), std::length_error);
+
+}
+
+void test_statistics_binned() {
+
+    RollStatistics stats;
+
+    TRY(stats = RollStatistics(Dice("10d100"), 100));
+    TEST(! stats.is_exact());
+    TEST_EQUAL(stats.bins(), 100u);
+    TEST_EQUAL(stats.bin_value(0), 10);
+    TEST_NEAR(stats.bin_width(), 9.9, 1e-12);
+
+    for (int i = 10; i <= 1000; ++i)
+        TRY(stats.add(i));
+
+    TEST_EQUAL(stats.count(), 991u);
+    TEST_NEAR(stats.mean(), 505, 1e-9);
+    TEST_NEAR(stats.percentile(50), 505, 5);
+    TEST_NEAR(stats.percentile(10), 109, 5);
+    TEST_EQUAL(stats.percentile(0), 10);
+    TEST_EQUAL(stats.percentile(100), 1000);
+
+}
+
+void test_statistics_merge() {
+
+    static constexpr int iterations = 10000;
+
+    Dice dice("3d6x2/3+1");
+    std::mt19937 rng(42);
+    RollStatistics all(dice), part1(dice), part2(dice);
+
+    for (int i = 0; i < iterations; ++i) {
+        auto x = dice(rng);
+        TRY(all.add(x));
+        TRY((i % 3 == 0 ? part1 : part2).add(x));
+    }
+
+    TRY(part1.merge(part2));
+    TEST_EQUAL(part1.count(), all.count());
+    TEST_EQUAL(part1.min(), all.min());
+    TEST_EQUAL(part1.max(), all.max());
+    TEST_NEAR(part1.mean(), all.mean(), 1e-9);
+    TEST_NEAR(part1.sd(), all.sd(), 1e-9);
+    for (std::size_t i = 0; i < all.bins(); ++i)
+        TEST_EQUAL(part1.bin_count(i), all.bin_count(i));
+    TEST_NEAR(all.mean(), double(dice.mean()), 4 * dice.sd() / std::sqrt(double(iterations)));
+    TEST_NEAR(all.sd(), dice.sd(), 0.05);
+
+    RollStatistics other(Dice("d6"));
+    TRY(other.add(1));
+    TEST_THROW(part1.merge(other), std::invalid_argument);
+
+}
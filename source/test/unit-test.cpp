@@ -10,13 +10,71 @@ int main(int argc, char** argv) {
     UNIT_TEST(rational_formatting)
     UNIT_TEST(rational_arithmetic)
     UNIT_TEST(rational_conversion)
+    UNIT_TEST(rational_overflow)
+
+    // random-test.cpp
+    UNIT_TEST(random_bits)
+    UNIT_TEST(random_uniform_integer)
+    UNIT_TEST(random_binomial_integer)
+    UNIT_TEST(random_philox)
+
+    // distribution-test.cpp
+    UNIT_TEST(distribution_construction)
+    UNIT_TEST(distribution_arithmetic)
+    UNIT_TEST(distribution_queries)
+    UNIT_TEST(distribution_large_convolution)
+
+    // alias-table-test.cpp
+    UNIT_TEST(alias_table_sampling)
+
+    // kernel-test.cpp
+    UNIT_TEST(kernel_instruction_sets)
+    UNIT_TEST(kernel_distribution)
 
     // dice-test.cpp
     UNIT_TEST(dice_arithmetic)
     UNIT_TEST(dice_statistics)
     UNIT_TEST(dice_parser)
+    UNIT_TEST(dice_parser_errors)
     UNIT_TEST(dice_generation)
     UNIT_TEST(dice_literals)
+    UNIT_TEST(dice_distribution)
+    UNIT_TEST(dice_sampling_modes)
+    UNIT_TEST(dice_batch_generation)
+    UNIT_TEST(dice_scaled_generation)
+    UNIT_TEST(dice_keep_modifiers)
+    UNIT_TEST(dice_explode_reroll)
+    UNIT_TEST(dice_success_pools)
+    UNIT_TEST(dice_comparison)
+
+    // compiled-dice-test.cpp
+    UNIT_TEST(compiled_dice_construction)
+    UNIT_TEST(compiled_dice_generation)
+
+    // dice-cache-test.cpp
+    UNIT_TEST(dice_cache_lookup)
+    UNIT_TEST(dice_cache_eviction)
+    UNIT_TEST(dice_cache_aliases)
+    UNIT_TEST(dice_cache_tables)
+    UNIT_TEST(dice_cache_threads)
+
+    // output-buffer-test.cpp
+    UNIT_TEST(output_buffer_text)
+    UNIT_TEST(output_buffer_numbers)
+    UNIT_TEST(output_buffer_binary)
+
+    // statistics-test.cpp
+    UNIT_TEST(statistics_exact)
+    UNIT_TEST(statistics_binned)
+    UNIT_TEST(statistics_merge)
+
+    // fixed-dice-test.cpp
+    UNIT_TEST(fixed_dice_construction)
+    UNIT_TEST(fixed_dice_generation)
+
+    // small-vector-test.cpp
+    UNIT_TEST(small_vector_insertion)
+    UNIT_TEST(small_vector_copy_move)
 
     return RS::UnitTest::end_tests();
 